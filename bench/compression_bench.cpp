@@ -0,0 +1,128 @@
+// What compressing the GraphML output costs. Formats a generated graph into a
+// stream which throws everything away, once as is and once through each
+// compressor, and prints the throughput of each in uncompressed bytes. Run
+// with the number of nodes, the number of formatting threads, and optionally
+// a compression level, e.g. compression_bench 1000000 4 3
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <tuple>
+
+#include "compressed_output.h"
+#include "graph.h"
+#include "graphml_writer.h"
+
+namespace {
+/// Counts what it is given and keeps none of it
+class CountingBuffer final : public std::streambuf
+{
+  public:
+    [[nodiscard]] size_t count() const { return m_count; }
+
+  protected:
+    std::streamsize xsputn(const char* /*bytes*/, std::streamsize size) override
+    {
+        m_count += static_cast<size_t>(size);
+        return size;
+    }
+
+    int_type overflow(int_type character) override
+    {
+        ++m_count;
+        return traits_type::not_eof(character);
+    }
+
+  private:
+    size_t m_count = 0;
+};
+
+/// Shaped roughly like a real program: mostly nested declarations with long
+/// qualified names, a handful of edges each
+cn::Graph make_graph(size_t num_nodes, std::pmr::memory_resource& resource)
+{
+    cn::Graph graph(&resource);
+    for (size_t i = 0; i < num_nodes; ++i) {
+        graph.kinds.push_back(static_cast<cn::SymbolKind>(i % 4));
+        graph.parents.push_back(i == 0 ? cn::no_node
+                                       : static_cast<cn::NodeId>(i / 8));
+        graph.name_ids.push_back(
+            graph.add_name("SomeDescriptiveName" + std::to_string(i)));
+    }
+    graph.edge_offsets.push_back(0);
+    for (size_t i = 0; i < num_nodes; ++i) {
+        for (size_t edge = 0; edge < i % 7; ++edge) {
+            graph.edge_targets.push_back(
+                static_cast<cn::NodeId>((i * 31 + edge * 977) % num_nodes));
+            graph.edge_kinds.push_back(static_cast<cn::EdgeKind>(edge % 7));
+            graph.edge_weights.push_back(static_cast<uint32_t>(1 + i % 3));
+        }
+        graph.edge_offsets.push_back(
+            static_cast<uint32_t>(graph.edge_targets.size()));
+    }
+    graph.build_reverse_edges();
+    return graph;
+}
+
+/// Returns how many bytes came out
+size_t run(const char* label, const cn::Graph& graph, size_t num_threads,
+           cn::Compression compression, std::optional<int> level,
+           size_t uncompressed)
+{
+    CountingBuffer counter;
+    std::ostream sink(&counter);
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        cn::CompressingStream stream(sink, compression, level);
+        std::ignore = cn::write_graphml(graph.view(), stream, num_threads);
+        std::ignore = stream.close();
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count();
+
+    // the uncompressed run measures itself
+    if (uncompressed == 0) {
+        uncompressed = counter.count();
+    }
+    std::printf("%-8s %10.1f ms %10.1f MB/s  %zu -> %zu bytes\n", label,
+                seconds * 1000.0,
+                static_cast<double>(uncompressed) / seconds / 1e6,
+                uncompressed, counter.count());
+    return counter.count();
+}
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+    const size_t num_nodes = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                      : 1'000'000;
+    const size_t num_threads =
+        argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+    std::optional<int> level{};
+    if (argc > 3) {
+        level = std::atoi(argv[3]);
+    }
+
+    std::pmr::monotonic_buffer_resource resource;
+    const cn::Graph graph = make_graph(num_nodes, resource);
+    std::printf("%zu nodes, %zu edges, %zu threads\n", graph.num_nodes(),
+                graph.num_edges(), num_threads);
+
+    // passed through the same thread and buffers, so that the difference is
+    // only the compressor itself
+    const size_t uncompressed =
+        run("none", graph, num_threads, cn::Compression::None, {}, 0);
+    std::ignore = run("zstd", graph, num_threads, cn::Compression::Zstd, level,
+                      uncompressed);
+    std::ignore = run("gzip", graph, num_threads, cn::Compression::Gzip, level,
+                      uncompressed);
+
+    return EXIT_SUCCESS;
+}
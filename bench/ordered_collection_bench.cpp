@@ -0,0 +1,157 @@
+// Compares OrderedCollectionSmall against OrderedCollectionImpl on each of
+// the standard containers it can sit on top of, with the shape of collection
+// the parser makes: lots of them, almost all holding a handful of elements,
+// filled once and then walked front to back. Run with the number of
+// collections, e.g. ordered_collection_bench 1000000
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <forward_list>
+#include <list>
+#include <memory_resource>
+#include <random>
+#include <vector>
+
+#include "aliases.h"
+
+namespace {
+/// About the size of a TypeIdentifier
+struct Element
+{
+    explicit Element(size_t value) : first(value) {}
+
+    size_t first;
+    size_t padding[3]{};
+};
+
+/// Counts what the collections ask for, and passes it on
+class CountingResource : public std::pmr::memory_resource
+{
+  public:
+    explicit CountingResource(std::pmr::memory_resource* upstream)
+        : m_upstream(upstream)
+    {
+    }
+
+    [[nodiscard]] size_t bytes() const { return m_bytes; }
+    [[nodiscard]] size_t allocations() const { return m_allocations; }
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        m_bytes += bytes;
+        ++m_allocations;
+        return m_upstream->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+    {
+        m_upstream->deallocate(pointer, bytes, alignment);
+    }
+
+    [[nodiscard]] bool
+    do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* m_upstream;
+    size_t m_bytes = 0;
+    size_t m_allocations = 0;
+};
+
+/// Mostly zero to four elements, like parameter lists and base classes, with
+/// the odd class that has hundreds of members
+std::vector<size_t> make_sizes(size_t count)
+{
+    std::mt19937_64 random(1234);
+    std::discrete_distribution<size_t> small({30, 30, 20, 10, 5});
+    std::uniform_int_distribution<size_t> large(5, 500);
+    std::uniform_int_distribution<size_t> percent(0, 99);
+
+    std::vector<size_t> out;
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        out.push_back(percent(random) < 2 ? large(random) : small(random));
+    }
+    return out;
+}
+
+template <typename Collection>
+void run(const char* label, const std::vector<size_t>& sizes, size_t walks)
+{
+    std::pmr::unsynchronized_pool_resource pool;
+    CountingResource counting(&pool);
+    std::pmr::polymorphic_allocator<> allocator(&counting);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::pmr::vector<Collection> collections(allocator);
+    collections.reserve(sizes.size());
+    const size_t reserved_bytes = counting.bytes();
+    const size_t reserved_allocations = counting.allocations();
+
+    for (const size_t size : sizes) {
+        Collection& collection = collections.emplace_back(allocator);
+        collection.reserve(size);
+        for (size_t i = 0; i < size; ++i) {
+            collection.emplace_back(i);
+        }
+    }
+    const auto filled = std::chrono::steady_clock::now();
+
+    size_t sum = 0;
+    for (size_t walk = 0; walk < walks; ++walk) {
+        for (const Collection& collection : collections) {
+            for (size_t i = 0; i < collection.size(); ++i) {
+                sum += collection.at(i).first;
+            }
+        }
+    }
+    const auto walked = std::chrono::steady_clock::now();
+
+    const auto ms = [](auto duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    };
+    // the collections themselves count too, that is where inline elements
+    // live, but not how the vector holding them was allocated
+    const size_t bytes = counting.bytes() - reserved_bytes +
+                         sizeof(Collection) * collections.size();
+    std::printf("%-26s %4zu B %9.1f ms fill %9.1f ms walk %8.1f MiB %10zu "
+                "allocs  (%zu)\n",
+                label, sizeof(Collection), ms(filled - start),
+                ms(walked - filled),
+                static_cast<double>(bytes) / (1024.0 * 1024.0),
+                counting.allocations() - reserved_allocations, sum);
+}
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+    const size_t num_collections =
+        argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+    const size_t walks = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4;
+
+    const auto sizes = make_sizes(num_collections);
+    size_t num_elements = 0;
+    for (const size_t size : sizes) {
+        num_elements += size;
+    }
+    std::printf("%zu collections, %zu elements, walked %zu times\n",
+                sizes.size(), num_elements, walks);
+
+    run<OrderedCollectionImpl<Element, std::pmr::deque>>("deque", sizes,
+                                                          walks);
+    run<OrderedCollectionImpl<Element, std::pmr::list>>("list", sizes, walks);
+    run<OrderedCollectionImpl<Element, std::pmr::forward_list>>(
+        "forward_list", sizes, walks);
+    run<OrderedCollectionImpl<Element, std::pmr::vector>>("vector", sizes,
+                                                           walks);
+    run<OrderedCollectionSmall<Element, 0>>("small, no inline", sizes, walks);
+    run<OrderedCollectionSmall<Element, 2>>("small, 2 inline", sizes, walks);
+    run<OrderedCollectionSmall<Element, 4>>("small, 4 inline", sizes, walks);
+
+    return EXIT_SUCCESS;
+}
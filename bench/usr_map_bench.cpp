@@ -0,0 +1,148 @@
+// Compares UsrMap against the std::pmr::map the symbol table used to be,
+// with the same access pattern as the parser: every cursor looks its USR up,
+// and only the first sighting inserts. Run with the number of distinct USRs
+// and how many times each is looked up, e.g. usr_map_bench 1000000 8
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "usr_map.h"
+
+namespace {
+struct Value
+{
+    Value(std::string_view _usr, std::pmr::polymorphic_allocator<> allocator)
+        : usr(_usr, allocator)
+    {
+    }
+
+    std::pmr::string usr;
+};
+
+/// USRs shaped like clang's, long shared prefixes included, which is what
+/// makes string comparisons in a tree expensive
+std::vector<std::string> make_usrs(size_t count)
+{
+    std::vector<std::string> out;
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        out.push_back("c:@N@company@N@project@N@module" +
+                      std::to_string(i % 97) + "@S@Class" +
+                      std::to_string(i / 97) + "@F@method" +
+                      std::to_string(i % 13) + "#I#&1$@S@Argument#");
+    }
+    return out;
+}
+
+/// Order the parser would see USRs in, each one several times
+std::vector<std::string_view> make_lookups(const std::vector<std::string>& usrs,
+                                           size_t repeats)
+{
+    std::vector<std::string_view> out;
+    out.reserve(usrs.size() * repeats);
+    for (size_t i = 0; i < repeats; ++i) {
+        out.insert(out.end(), usrs.begin(), usrs.end());
+    }
+    std::mt19937_64 random(1234);
+    std::ranges::shuffle(out, random);
+    return out;
+}
+
+template <typename Callable> double time_ms(Callable&& callable)
+{
+    const auto start = std::chrono::steady_clock::now();
+    callable();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/// What create_or_find_symbol_with_cursor used to do: copy the USR, check
+/// contains, then insert through operator[]
+size_t run_map_copying(const std::vector<std::string_view>& lookups)
+{
+    std::pmr::monotonic_buffer_resource resource;
+    std::pmr::polymorphic_allocator<> allocator(&resource);
+    std::pmr::map<std::pmr::string, Value*> map(allocator);
+
+    for (const std::string_view usr_view : lookups) {
+        std::pmr::string usr{usr_view, allocator};
+        if (map.contains(usr)) {
+            continue;
+        }
+        auto* value = allocator.new_object<Value>(usr_view, allocator);
+        map[std::move(usr)] = value;
+    }
+    return map.size();
+}
+
+/// A transparent map, so at least the lookup does not copy
+size_t run_map_transparent(const std::vector<std::string_view>& lookups)
+{
+    std::pmr::monotonic_buffer_resource resource;
+    std::pmr::polymorphic_allocator<> allocator(&resource);
+    std::pmr::map<std::pmr::string, Value*, std::less<>> map(allocator);
+
+    for (const std::string_view usr : lookups) {
+        if (map.find(usr) != map.end()) {
+            continue;
+        }
+        auto* value = allocator.new_object<Value>(usr, allocator);
+        map.try_emplace(value->usr, value);
+    }
+    return map.size();
+}
+
+size_t run_usr_map(const std::vector<std::string_view>& lookups)
+{
+    std::pmr::monotonic_buffer_resource resource;
+    std::pmr::polymorphic_allocator<> allocator(&resource);
+    cn::UsrMap<Value> map(allocator);
+
+    for (const std::string_view usr : lookups) {
+        const uint64_t hash = cn::UsrMap<Value>::hash(usr);
+        if (map.find(usr, hash) != nullptr) {
+            continue;
+        }
+        auto* value = allocator.new_object<Value>(usr, allocator);
+        std::ignore = map.insert_or_get(value->usr, hash, value);
+    }
+    return map.size();
+}
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+    const size_t num_usrs = argc > 1 ? std::strtoull(argv[1], nullptr, 10)
+                                     : 1'000'000;
+    const size_t repeats = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8;
+
+    const auto usrs = make_usrs(num_usrs);
+    const auto lookups = make_lookups(usrs, repeats);
+
+    std::printf("%zu usrs, %zu lookups\n", usrs.size(), lookups.size());
+
+    size_t size = 0;
+    const double copying = time_ms([&] { size = run_map_copying(lookups); });
+    std::printf("%-24s %10.1f ms  (%zu symbols)\n", "pmr::map, copying",
+                copying, size);
+
+    const double transparent =
+        time_ms([&] { size = run_map_transparent(lookups); });
+    std::printf("%-24s %10.1f ms  (%zu symbols)\n", "pmr::map, transparent",
+                transparent, size);
+
+    const double usr_map = time_ms([&] { size = run_usr_map(lookups); });
+    std::printf("%-24s %10.1f ms  (%zu symbols)\n", "UsrMap", usr_map, size);
+
+    return EXIT_SUCCESS;
+}
@@ -41,6 +41,9 @@
             libllvm
             libffi
             libxml2
+            pkg-config
+            zlib
+            zstd
             valgrind
             gdb
             gephi
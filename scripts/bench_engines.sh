@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+# Compare the visitor and indexer extraction engines on the same compile
+# database, then check that they produced the same graph.
+#
+# usage: scripts/bench_engines.sh path/to/compile_commands.json [jobs]
+#
+# expects codenodes to be built into ./out (see the `build` alias) and
+# hyperfine to be on the PATH, both of which the nix dev shell provides.
+
+set -euo pipefail
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 path/to/compile_commands.json [jobs]" >&2
+    exit 1
+fi
+
+compile_commands=$1
+jobs=${2:-1}
+codenodes=${CODENODES:-./out/codenodes}
+output_dir=$(mktemp -d)
+trap 'rm -rf "$output_dir"' EXIT
+
+hyperfine \
+    --warmup 1 \
+    --export-markdown "$output_dir/results.md" \
+    -n visitor "$codenodes -c $compile_commands -j $jobs --engine visitor -o $output_dir/visitor.graphml" \
+    -n indexer "$codenodes -c $compile_commands -j $jobs --engine indexer -o $output_dir/indexer.graphml"
+
+cat "$output_dir/results.md"
+
+if cmp -s "$output_dir/visitor.graphml" "$output_dir/indexer.graphml"; then
+    echo "engines produced identical graphs"
+else
+    echo "WARNING: engines produced different graphs" >&2
+    for engine in visitor indexer; do
+        echo "$engine: $(grep -c '<node' "$output_dir/$engine.graphml") nodes," \
+            "$(grep -c '<edge' "$output_dir/$engine.graphml") edges" >&2
+    done
+fi
@@ -1,14 +1,19 @@
 #ifndef __ALIASES_H__
 #define __ALIASES_H__
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
-#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <deque>
 #include <forward_list>
 #include <list>
 #include <map>
+#include <memory>
 #include <memory_resource>
+#include <new>
 #include <span>
 #include <string>
 #include <utility>
@@ -19,10 +24,11 @@
 // feature though as there's already indirection for polymorphism with the
 // Symbol class, and anything thats by-value is just copied rather than having
 // its address taken
-template <typename T> class OrderedCollectionImpl
+template <typename T, template <typename> typename Container = std::pmr::deque>
+class OrderedCollectionImpl
 {
   private:
-    std::pmr::deque<T> elements;
+    Container<T> elements;
     mutable decltype(elements)::const_iterator last_visited_const;
     mutable size_t last_visited_const_index = 0;
     mutable bool is_cache_valid = false;
@@ -132,169 +138,167 @@ template <typename T> class OrderedCollectionImpl
     }
 };
 
-template <typename T> class OrderedCollectionCustom
+/// Storage for the inline elements of an OrderedCollectionSmall, which does
+/// not need T to be complete when there are none
+template <typename T, size_t Capacity> struct OrderedCollectionInlineStorage
 {
-  private:
-    static constexpr size_t block_size = 1;
-    static constexpr size_t num_initial_blocks = 1;
-
-    struct M
-    {
-        std::pmr::polymorphic_allocator<> allocator;
-        std::span<T*> block_dynamic_array;
-        size_t block_dynamic_array_num_occupied = 0;
-        size_t num_occupied = 0;
-    } m;
+    alignas(T) std::byte bytes[Capacity * sizeof(T)];
 
-    [[nodiscard]] constexpr size_t block_dynamic_array_size()
+    [[nodiscard]] T* data()
     {
-        return m.block_dynamic_array_num_occupied;
+        return std::launder(reinterpret_cast<T*>(bytes));
     }
-
-    [[nodiscard]] constexpr size_t block_dynamic_array_capacity()
+    [[nodiscard]] const T* data() const
     {
-        return m.block_dynamic_array.size();
-    }
-
-    [[nodiscard]] constexpr std::span<T> block_dynamic_array_get(size_t index)
-    {
-        assert(index >= block_dynamic_array_size());
-        return {m.block_dynamic_array[index], block_size};
+        return std::launder(reinterpret_cast<const T*>(bytes));
     }
+};
 
-    [[nodiscard]] constexpr size_t capacity()
-    {
-        return block_dynamic_array_size() * block_size;
-    }
+template <typename T> struct OrderedCollectionInlineStorage<T, 0>
+{
+    [[nodiscard]] T* data() { return nullptr; }
+    [[nodiscard]] const T* data() const { return nullptr; }
+};
 
+/// Keeps the first InlineCapacity elements inside of the collection itself,
+/// and the rest in blocks which each hold twice as many elements as the last.
+/// Blocks are never reallocated, so the common case of a handful of elements
+/// makes no allocations at all, and nothing is ever copied to grow. Element
+/// type has to be complete unless InlineCapacity is 0
+template <typename T, size_t InlineCapacity> class OrderedCollectionSmall
+{
   public:
-    OrderedCollectionCustom() = delete;
-    constexpr explicit OrderedCollectionCustom(
+    OrderedCollectionSmall() = delete;
+    constexpr explicit OrderedCollectionSmall(
         std::pmr::polymorphic_allocator<> allocator)
-        : m{allocator}
+        : m_allocator(allocator)
     {
     }
 
-    OrderedCollectionCustom(const OrderedCollectionCustom& other) = delete;
-    OrderedCollectionCustom&
-    operator=(const OrderedCollectionCustom& other) = delete;
+    OrderedCollectionSmall(const OrderedCollectionSmall& other) = delete;
+    OrderedCollectionSmall&
+    operator=(const OrderedCollectionSmall& other) = delete;
 
-    constexpr OrderedCollectionCustom(OrderedCollectionCustom&& other) noexcept
-        : m{std::move(other.m.allocator)}
+    constexpr OrderedCollectionSmall(OrderedCollectionSmall&& other) noexcept
+        : m_allocator(other.m_allocator),
+          m_blocks(std::exchange(other.m_blocks, nullptr)),
+          m_num_blocks(std::exchange(other.m_num_blocks, 0))
     {
-        m.num_occupied = std::exchange(other.m.num_occupied, 0);
-        m.block_dynamic_array = std::exchange(other.m.block_dynamic_array, {});
-        m.block_dynamic_array_num_occupied =
-            std::exchange(other.m.block_dynamic_array_num_occupied, 0);
+        const size_t num_inline = std::min(other.m_size, InlineCapacity);
+        for (size_t i = 0; i < num_inline; ++i) {
+            std::construct_at(m_inline.data() + i,
+                              std::move(other.m_inline.data()[i]));
+            std::destroy_at(other.m_inline.data() + i);
+        }
+        m_size = std::exchange(other.m_size, 0);
     }
 
-    constexpr OrderedCollectionCustom&
-    operator=(OrderedCollectionCustom&& other) noexcept = delete;
+    OrderedCollectionSmall&
+    operator=(OrderedCollectionSmall&& other) noexcept = delete;
 
-    constexpr ~OrderedCollectionCustom()
+    constexpr ~OrderedCollectionSmall()
     {
-        if (m.block_dynamic_array_num_occupied != 0) {
-            for (size_t block_index = 0;
-                 block_index < block_dynamic_array_size(); ++block_index) {
-                if constexpr (!std::is_trivially_destructible_v<T>) {
-                    for (size_t sub_index = 0; sub_index < block_size;
-                         ++sub_index) {
-                        m.block_dynamic_array[block_index][sub_index].~T();
-                    }
-                }
-                m.allocator.deallocate_bytes(m.block_dynamic_array[block_index],
-                                             block_size);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (size_t i = 0; i < m_size; ++i) {
+                std::destroy_at(&at(i));
             }
-            m.allocator.deallocate_bytes(m.block_dynamic_array.data(),
-                                         m.block_dynamic_array.size_bytes());
+        }
+        for (size_t block = 0; block < m_num_blocks; ++block) {
+            m_allocator.deallocate_object(m_blocks[block], block_size(block));
+        }
+        if (m_blocks != nullptr) {
+            m_allocator.deallocate_object(m_blocks, m_num_blocks);
         }
     }
 
-    // TODO: implement these
     template <typename... Args>
-        requires std::is_nothrow_constructible_v<T, Args...>
+        requires std::is_constructible_v<T, Args...>
     constexpr void emplace_back(Args&&... args)
     {
         T* target_slot = nullptr;
-        assert(capacity() >= size());
-        if (capacity() == size()) {
-            if (block_dynamic_array_capacity() == block_dynamic_array_size()) {
-                reallocate_blocks_leave_uninit();
-            }
-            assert(block_dynamic_array_capacity() > block_dynamic_array_size());
-
-            T*& next = m.block_dynamic_array[block_dynamic_array_size()];
-
-            next = static_cast<T*>(
-                m.allocator.allocate_bytes(sizeof(T) * block_size, alignof(T)));
-            ++m.block_dynamic_array_num_occupied;
-
-            if (next == nullptr) {
-                std::abort();
-            }
-
-            target_slot = next;
+        if (m_size < InlineCapacity) {
+            target_slot = m_inline.data() + m_size;
         } else {
-            // in this case, we have space already
-            std::span last =
-                block_dynamic_array_get(block_dynamic_array_size() - 1);
-
-            target_slot = last.data() + (size() % block_size);
+            const auto [block, offset] = locate(m_size);
+            if (block == m_num_blocks) {
+                add_block();
+            }
+            target_slot = m_blocks[block] + offset;
         }
-
-        assert(capacity() > size());
         std::construct_at(target_slot, std::forward<Args>(args)...);
-        ++m.num_occupied;
+        ++m_size;
     }
 
+    /// blocks are allocated as they fill up either way, nothing to gain
     constexpr void reserve(size_t /**/) {}
 
     [[nodiscard]] constexpr const T& at(size_t index) const
     {
-        if (index >= size()) {
+        if (index >= m_size) {
             std::abort();
         }
-        assert(index / block_size < block_dynamic_array_size());
-        return m.block_dynamic_array[index / block_size][index % block_size];
+        if (index < InlineCapacity) {
+            return m_inline.data()[index];
+        }
+        const auto [block, offset] = locate(index);
+        return m_blocks[block][offset];
     }
 
-    [[nodiscard]] constexpr size_t size() const { return m.num_occupied; }
+    [[nodiscard]] constexpr size_t size() const { return m_size; }
 
   private:
-    // reallocates a buffer and leaves new items uninitialized
-    void reallocate_blocks_leave_uninit()
+    struct Location
     {
-        const size_t new_buffer_size_items_multiplier =
-            std::ceilf(float(m.block_dynamic_array.size()) * 1.5F);
-        const size_t new_buffer_size_items =
-            new_buffer_size_items_multiplier == 0
-                ? num_initial_blocks
-                : new_buffer_size_items_multiplier;
-        const size_t new_buffer_size_bytes = new_buffer_size_items * sizeof(T*);
-
-        void* new_buffer_mem =
-            m.allocator.allocate_bytes(new_buffer_size_bytes, alignof(T*));
-
-        if (new_buffer_mem == nullptr) {
-            std::abort();
-        }
+        size_t block;
+        size_t offset;
+    };
 
-        std::memcpy(new_buffer_mem, m.block_dynamic_array.data(),
-                    m.block_dynamic_array.size_bytes());
+    // at least a cache line or so worth of elements in the first block
+    static constexpr size_t first_block_size =
+        std::bit_ceil(std::max<size_t>(InlineCapacity, 4));
 
-        m.allocator.deallocate_bytes(m.block_dynamic_array.data(),
-                                     m.block_dynamic_array.size_bytes());
+    [[nodiscard]] static constexpr size_t block_size(size_t block)
+    {
+        return first_block_size << block;
+    }
 
-        const size_t old_size_items = m.block_dynamic_array.size();
-        m.block_dynamic_array = std::span<T*>{
-            static_cast<T**>(new_buffer_mem),
-            new_buffer_size_items,
+    /// Block k starts at first_block_size * (2^k - 1) past the inline
+    /// elements
+    [[nodiscard]] static constexpr Location locate(size_t index)
+    {
+        const size_t spilled = index - InlineCapacity;
+        const size_t block = std::bit_width(spilled / first_block_size + 1) - 1;
+        return {
+            .block = block,
+            .offset = spilled - (first_block_size * ((size_t{1} << block) - 1)),
         };
     }
+
+    void add_block()
+    {
+        // the block list only grows once per block, logarithmically often
+        T** blocks = m_allocator.allocate_object<T*>(m_num_blocks + 1);
+        if (m_blocks != nullptr) {
+            std::memcpy(blocks, m_blocks, m_num_blocks * sizeof(T*));
+            m_allocator.deallocate_object(m_blocks, m_num_blocks);
+        }
+        blocks[m_num_blocks] =
+            m_allocator.allocate_object<T>(block_size(m_num_blocks));
+        m_blocks = blocks;
+        ++m_num_blocks;
+    }
+
+    std::pmr::polymorphic_allocator<> m_allocator;
+    T** m_blocks = nullptr;
+    uint32_t m_num_blocks = 0;
+    size_t m_size = 0;
+    [[no_unique_address]] OrderedCollectionInlineStorage<T, InlineCapacity>
+        m_inline;
 };
 
-// template <typename T> using OrderedCollection = OrderedCollectionImpl<T>;
-template <typename T> using OrderedCollection = OrderedCollectionCustom<T>;
+/// Most collections only ever hold a couple of elements
+template <typename T, size_t InlineCapacity = 2>
+using OrderedCollection = OrderedCollectionSmall<T, InlineCapacity>;
 
 using String = std::pmr::string;
 
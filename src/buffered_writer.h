@@ -0,0 +1,92 @@
+#ifndef __CODENODES_BUFFERED_WRITER_H__
+#define __CODENODES_BUFFERED_WRITER_H__
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <tuple>
+
+namespace cn {
+
+/// Collects small writes into one large buffer so the stream only ever sees a
+/// few big ones. Flushes when destroyed
+class BufferedWriter
+{
+  public:
+    static constexpr size_t default_capacity = size_t{1} << 20;
+
+    explicit BufferedWriter(std::ostream& output,
+                            size_t capacity = default_capacity)
+        : m_output(output), m_buffer(std::make_unique<char[]>(capacity)),
+          m_capacity(capacity)
+    {
+    }
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+    BufferedWriter(BufferedWriter&&) = delete;
+    BufferedWriter& operator=(BufferedWriter&&) = delete;
+
+    ~BufferedWriter() { std::ignore = flush(); }
+
+    void write(std::string_view bytes)
+    {
+        // empty spans may not have anywhere to copy from
+        if (bytes.empty()) {
+            return;
+        }
+        if (bytes.size() > m_capacity - m_size) {
+            std::ignore = flush();
+            // too big to be worth copying
+            if (bytes.size() >= m_capacity) {
+                m_output.write(bytes.data(),
+                               static_cast<std::streamsize>(bytes.size()));
+                return;
+            }
+        }
+        std::memcpy(m_buffer.get() + m_size, bytes.data(), bytes.size());
+        m_size += bytes.size();
+    }
+
+    void put(char character)
+    {
+        if (m_size == m_capacity) {
+            std::ignore = flush();
+        }
+        m_buffer[m_size++] = character;
+    }
+
+    void write_decimal(uint64_t value)
+    {
+        // enough digits for any uint64_t
+        if (m_capacity - m_size < 20) {
+            std::ignore = flush();
+        }
+        char* begin = m_buffer.get() + m_size;
+        m_size = std::to_chars(begin, begin + 20, value).ptr - m_buffer.get();
+    }
+
+    /// Hands everything buffered to the stream, false if the stream failed
+    [[nodiscard]] bool flush()
+    {
+        if (m_size != 0) {
+            m_output.write(m_buffer.get(),
+                           static_cast<std::streamsize>(m_size));
+            m_size = 0;
+        }
+        return m_output.good();
+    }
+
+  private:
+    std::ostream& m_output;
+    std::unique_ptr<char[]> m_buffer;
+    size_t m_capacity;
+    size_t m_size = 0;
+};
+
+} // namespace cn
+
+#endif
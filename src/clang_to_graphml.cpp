@@ -1,146 +1,381 @@
+#include <algorithm>
 #include <cassert>
-#include <cstring>
-#include <pugixml.hpp>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <limits>
+#include <fnmatch.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "clang_to_graphml_impl.h"
+#include "graph_file.h"
+#include "graphml_writer.h"
 
 namespace cn {
 
+namespace {
+/// Per thread clang state, reused by every job that thread runs
+struct WorkerState
+{
+    explicit WorkerState(ExtractionEngine engine)
+        : index(clang_createIndex(0, 0)),
+          index_action(engine == ExtractionEngine::Indexer
+                           ? clang_IndexAction_create(index)
+                           : nullptr)
+    {
+    }
+
+    WorkerState(const WorkerState&) = delete;
+    WorkerState& operator=(const WorkerState&) = delete;
+    WorkerState(WorkerState&&) = delete;
+    WorkerState& operator=(WorkerState&&) = delete;
+
+    ~WorkerState()
+    {
+        if (index_action != nullptr) {
+            clang_IndexAction_dispose(index_action);
+        }
+        clang_disposeIndex(index);
+    }
+
+    CXIndex index;
+    // only used by the indexer engine. it remembers which function bodies it
+    // already parsed, so it lives as long as the worker
+    CXIndexAction index_action;
+    // backs Job::scratch, released after every job. its buffers are kept
+    // around by the upstream pool, so after the first few jobs this rarely
+    // allocates
+    std::pmr::unsynchronized_pool_resource scratch_upstream;
+    std::pmr::monotonic_buffer_resource scratch{&scratch_upstream};
+};
+
+/// unity_members are #included by an in-memory source named filename, if
+/// given
+void run_engine(ClangToGraphMLBuilder::Job* job, WorkerState& worker,
+                const char* filename, std::span<const char* const> command_args,
+                std::span<const std::string> unity_members = {}) noexcept
+{
+    job->scratch.emplace(&worker.scratch);
+
+    for (const auto& member : unity_members) {
+        job->scratch->unity_source.append("#include \"");
+        job->scratch->unity_source.append(member);
+        job->scratch->unity_source.append("\"\n");
+    }
+
+    switch (job->shared_data->options.engine) {
+    case ExtractionEngine::Visitor:
+        job->run(worker.index, filename, command_args);
+        break;
+    case ExtractionEngine::Indexer:
+        job->run_indexer(worker.index_action, filename, command_args);
+        break;
+    }
+
+    // the containers have to go before the memory they live in
+    job->scratch.reset();
+    worker.scratch.release();
+}
+
+void finish_job(ClangToGraphMLBuilder::PersistentData* data,
+                ClangToGraphMLBuilder::Job* job) noexcept
+{
+    std::lock_guard lock(data->finished_jobs_mutex);
+    data->finished_jobs.emplace_back(job);
+}
+
+void run_job(ClangToGraphMLBuilder::PersistentData* data, WorkerState& worker,
+             const char* filename,
+             std::span<const char* const> command_args) noexcept
+{
+    auto* job = data->allocator.new_object<ClangToGraphMLBuilder::Job>(data);
+
+    if (data->fragment_cache.has_value()) {
+        job->main_file = filename;
+        job->cache_key = data->fragment_cache->key_for(filename, command_args,
+                                                       data->options);
+        job->loaded_from_cache =
+            job->cache_key.has_value() && job->load_fragment();
+    }
+
+    if (!job->loaded_from_cache) {
+        run_engine(job, worker, filename, command_args);
+    }
+
+    finish_job(data, job);
+}
+
+/// Parse several translation units with the same arguments as one, by
+/// #including each of them from an in-memory source
+void run_unity_job(ClangToGraphMLBuilder::PersistentData* data,
+                   WorkerState& worker, std::span<const std::string> filenames,
+                   std::span<const char* const> command_args) noexcept
+{
+    auto* job = data->allocator.new_object<ClangToGraphMLBuilder::Job>(data);
+
+    // next to the first member and with the same extension, so that clang
+    // guesses the same language for it when there is no -x
+    const std::string& first = filenames.front();
+    const std::string unity_filename =
+        first + ".unity" + std::filesystem::path{first}.extension().native();
+
+    run_engine(job, worker, unity_filename.c_str(), command_args, filenames);
+
+    finish_job(data, job);
+}
+} // namespace
+
+/// Owns the threads which run jobs, each with its own CXIndex. With only one
+/// job there are no threads and jobs run on the caller's thread.
+struct ClangToGraphMLBuilder::WorkerPool
+{
+    struct PendingJob
+    {
+        // more than one for a unity batch
+        std::vector<std::string> filenames;
+        std::vector<std::string> command_args;
+    };
+
+    explicit WorkerPool(PersistentData* data) : shared_data(data)
+    {
+        const size_t num_jobs = data->options.num_jobs;
+        if (num_jobs <= 1) {
+            inline_worker.emplace(data->options.engine);
+            return;
+        }
+
+        workers.reserve(num_jobs);
+        for (size_t i = 0; i < num_jobs; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    WorkerPool(WorkerPool&&) = delete;
+    WorkerPool& operator=(WorkerPool&&) = delete;
+
+    ~WorkerPool() { join(); }
+
+    void push(const char* filename,
+              std::span<const char* const> command_args) noexcept
+    {
+        if (shared_data->options.unity_batch > 1) {
+            add_to_unity_batch(filename, command_args);
+            return;
+        }
+
+        if (inline_worker.has_value()) {
+            run_job(shared_data, inline_worker.value(), filename, command_args);
+            return;
+        }
+
+        enqueue(PendingJob{
+            .filenames = {filename},
+            .command_args = {command_args.begin(), command_args.end()},
+        });
+    }
+
+    /// Wait for all pushed jobs to finish. No jobs may be pushed afterwards
+    void join() noexcept
+    {
+        // whatever is left over makes for smaller batches
+        for (auto& [key, batch] : unity_batches) {
+            if (!batch.filenames.empty()) {
+                enqueue(std::move(batch));
+            }
+        }
+        unity_batches.clear();
+
+        {
+            std::lock_guard lock(mutex);
+            closed = true;
+        }
+        condition.notify_all();
+        for (auto& worker : workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+  private:
+    void add_to_unity_batch(const char* filename,
+                            std::span<const char* const> command_args)
+    {
+        unity_key.clear();
+        for (const char* arg : command_args) {
+            unity_key.append(arg);
+            unity_key.push_back('\0');
+        }
+
+        auto [iter, inserted] = unity_batches.try_emplace(unity_key);
+        PendingJob& batch = iter->second;
+        if (inserted) {
+            batch.command_args.assign(command_args.begin(), command_args.end());
+        }
+        batch.filenames.emplace_back(filename);
+
+        if (batch.filenames.size() >= shared_data->options.unity_batch) {
+            // keep the args around for the next batch with the same key
+            enqueue(PendingJob{
+                .filenames = std::exchange(batch.filenames, {}),
+                .command_args = batch.command_args,
+            });
+        }
+    }
+
+    void enqueue(PendingJob&& pending)
+    {
+        if (inline_worker.has_value()) {
+            std::vector<const char*> command_args;
+            run_pending(inline_worker.value(), pending, command_args);
+            return;
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            queue.emplace_back(std::move(pending));
+        }
+        condition.notify_one();
+    }
+
+    /// command_args is scratch space, reused between calls
+    void run_pending(WorkerState& worker, const PendingJob& pending,
+                     std::vector<const char*>& command_args) noexcept
+    {
+        command_args.clear();
+        for (const auto& arg : pending.command_args) {
+            command_args.push_back(arg.c_str());
+        }
+
+        if (pending.filenames.size() == 1) {
+            run_job(shared_data, worker, pending.filenames.front().c_str(),
+                    command_args);
+        } else {
+            run_unity_job(shared_data, worker, pending.filenames,
+                          command_args);
+        }
+    }
+
+    void work() noexcept
+    {
+        WorkerState worker(shared_data->options.engine);
+        std::vector<const char*> command_args;
+
+        while (true) {
+            PendingJob pending;
+            {
+                std::unique_lock lock(mutex);
+                condition.wait(lock,
+                               [this] { return closed || !queue.empty(); });
+                if (queue.empty()) {
+                    break;
+                }
+                pending = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            run_pending(worker, pending, command_args);
+        }
+    }
+
+    PersistentData* shared_data;
+    std::optional<WorkerState> inline_worker;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<PendingJob> queue;
+    bool closed = false;
+    std::vector<std::thread> workers;
+    // only touched by the thread calling push. keyed by the arguments, each
+    // followed by a null terminator
+    std::unordered_map<std::string, PendingJob> unity_batches;
+    std::string unity_key;
+};
+
 ClangToGraphMLBuilder::ClangToGraphMLBuilder(
-    std::pmr::memory_resource& memory_resource)
+    std::pmr::memory_resource& memory_resource, const BuilderOptions& options)
     : m_allocator(&memory_resource),
-      m_data(m_allocator.new_object<PersistentData>(&memory_resource))
+      m_data(m_allocator.new_object<PersistentData>(&memory_resource, options)),
+      m_pool(m_allocator.new_object<WorkerPool>(m_data))
 {
 }
 
 ClangToGraphMLBuilder::~ClangToGraphMLBuilder()
 {
+    // pool first, its threads may still be using the persistent data
+    m_allocator.delete_object(m_pool);
     m_allocator.delete_object(m_data);
 }
 
 void ClangToGraphMLBuilder::parse(
     const char* filename, std::span<const char* const> command_args) noexcept
 {
-    Job* job = m_allocator.new_object<Job>(m_data);
-    job->run(filename, command_args);
-    m_data->finished_jobs.emplace_back(job);
+    m_pool->push(filename, command_args);
 }
 
 enum CXChildVisitResult ClangToGraphMLBuilder::Job::top_level_cursor_visitor(
     CXCursor current_cursor, CXCursor /*parent*/, void* userdata)
 {
-    const CXCursor old_cursor = current_cursor;
-    current_cursor = clang_getCanonicalCursor(current_cursor);
+    auto* job = static_cast<Job*>(userdata);
 
-    // skip forward declarations altogether
-    // if (0 != memcmp(&old_cursor, &current_cursor, sizeof(CXCursor))) {
-    //     return CXChildVisit_Continue;
-    // }
+    if (const auto& status = job->file_status(current_cursor);
+        status.indexed || status.out_of_scope) {
+        return CXChildVisit_Continue;
+    }
 
-    auto* job = static_cast<Job*>(userdata);
-    PersistentData* data = job->shared_data;
+    // namespace blocks are not canonicalized, every reopening of a namespace
+    // has different children
+    if (clang_getCursorKind(current_cursor) != CXCursor_Namespace) {
+        current_cursor = clang_getCanonicalCursor(current_cursor);
+    }
 
     enum CXCursorKind kind = clang_getCursorKind(current_cursor);
 
+    // the file this is written in is in scope, even if the canonical
+    // declaration's isn't
     switch (kind) {
     case CXCursorKind::CXCursor_Namespace: {
-        auto& namespace_symbol =
+        job->mark_in_scope(
             job->create_or_find_symbol_with_cursor<NamespaceSymbol>(
-                current_cursor);
+                current_cursor));
         break;
     }
-    case CXCursorKind::CXCursor_FunctionDecl: {
-        auto& function_symbol =
-            job->create_or_find_symbol_with_cursor<FunctionSymbol>(
-                current_cursor);
+    case CXCursorKind::CXCursor_FunctionDecl:
+    // methods only show up at the top level when they are defined outside of
+    // their class, which is where their body is
+    case CXCursorKind::CXCursor_CXXMethod:
+    case CXCursorKind::CXCursor_Constructor:
+    case CXCursorKind::CXCursor_Destructor:
+    case CXCursorKind::CXCursor_ConversionFunction: {
+        if (FunctionSymbol::is_representable(current_cursor)) {
+            job->mark_in_scope(
+                job->create_or_find_symbol_with_cursor<FunctionSymbol>(
+                    current_cursor));
+        }
         break;
     }
     case CXCursorKind::CXCursor_EnumDecl: {
-        auto& enum_symbol =
+        job->mark_in_scope(
             job->create_or_find_symbol_with_cursor<EnumTypeSymbol>(
-                current_cursor);
+                current_cursor));
         break;
     }
     case CXCursorKind::CXCursor_StructDecl:
     case CXCursorKind::CXCursor_UnionDecl:
     case CXCursorKind::CXCursor_ClassDecl: {
-        auto& class_symbol =
-            job->create_or_find_symbol_with_cursor<ClassSymbol>(current_cursor);
-        break;
-    }
-    case CXCursorKind::CXCursor_CXXMethod: {
-        // clang_Cursor_getNumArguments
-        // clang_Cursor_isDynamicCall()
-        break;
-    }
-    case CXCursorKind::CXCursor_CallExpr: {
-        CXCursor function = clang_getCursorReferenced(current_cursor);
-        enum CXCursorKind kind = clang_getCursorKind(function);
-
-        auto is_function =
-            kind == CXCursor_CXXMethod || kind == CXCursor_FunctionDecl ||
-            kind == CXCursor_Constructor || kind == CXCursor_Destructor ||
-            kind == CXCursor_ConversionFunction;
-
-        if (!is_function) {
-            auto name = [&]() -> std::optional<const char*> {
-                switch (kind) {
-                case CXCursor_FirstInvalid:
-                    return {};
-                    return "CXCursor_FirstInvalid";
-                case CXCursor_VarDecl:
-                    return "CXCursor_VarDecl";
-                case CXCursor_ParmDecl:
-                    return "CXCursor_ParmDecl";
-                case CXCursor_FieldDecl:
-                    return "CXCursor_FieldDecl";
-                default:
-                    return {};
-                }
-            }();
-
-            // this should never happen
-            if (!name) {
-                break;
-                auto callsym =
-                    OwningCXString::clang_getCursorSpelling(current_cursor);
-                auto defsym = OwningCXString::clang_getCursorSpelling(function);
-                std::ignore = fprintf(
-                    stderr,
-                    "Found callexpr which does not reference a function: "
-                    "callsym is %s and defsym is %s with kind %d named "
-                    "%s\n",
-                    callsym.c_str(), defsym.c_str(), static_cast<int>(kind),
-                    name.value_or("unknown"));
-                break;
-            }
-
-            // CXSourceLocation location =
-            // clang_getCursorLocation(current_cursor);
-
-            // CXFile file{};
-            // uint32_t line{};
-            // clang_getSpellingLocation(location, &file, &line, nullptr,
-            // nullptr);
-
-            // if (clang_Location_isInSystemHeader(location) != 0) {
-            //     break;
-            // }
-
-            // // to get containing class or namespace:
-            // clang_getCursorSemanticParent(current_cursor);
-
-            // printf("callexpr %s is of type %s in file %s line %u\n",
-            //        OwningCXString::clang_getCursorDisplayName(current_cursor)
-            //            .c_str(),
-            //        name.value(),
-            //        OwningCXString::clang_getFileName(file).c_str(), line);
-
-            break;
-        }
-
+        job->mark_in_scope(
+            job->create_or_find_symbol_with_cursor<ClassSymbol>(
+                current_cursor));
         break;
     }
+    case CXCursorKind::CXCursor_LinkageSpec:
+        // extern "C" blocks, same as in namespaces
+        return CXChildVisit_Recurse;
     default:
         // do nothing
         break;
@@ -150,14 +385,18 @@ enum CXChildVisitResult ClangToGraphMLBuilder::Job::top_level_cursor_visitor(
 }
 
 void ClangToGraphMLBuilder::Job::run(
-    const char* filename, std::span<const char* const> command_args) noexcept
+    CXIndex index, const char* filename,
+    std::span<const char* const> command_args) noexcept
 {
-    CXIndex index = clang_createIndex(0, 0);
-
+    // command_args starts with the compiler, as argv[0] would, and does not
+    // include the input file
     CXTranslationUnit unit{};
-    CXErrorCode error = clang_parseTranslationUnit2(
-        index, filename, /* command_args.data(), */ nullptr, 0, nullptr, 0,
-        CXTranslationUnit_None, &unit);
+    const std::span<CXUnsavedFile> unsaved = unsaved_files(filename);
+    CXErrorCode error = clang_parseTranslationUnit2FullArgv(
+        index, filename, command_args.data(),
+        static_cast<int>(command_args.size()), unsaved.data(),
+        static_cast<unsigned>(unsaved.size()),
+        translation_unit_flags(shared_data->options.depth), &unit);
 
     if (error != CXError_Success) {
         std::ignore = fprintf(stderr,
@@ -165,15 +404,47 @@ void ClangToGraphMLBuilder::Job::run(
                               "error code %d, aborting.\n",
                               filename, error);
         clang_disposeTranslationUnit(unit);
-        clang_disposeIndex(index);
         return;
     }
 
+    report_diagnostics(unit, filename);
+
+    if (shared_data->options.max_include_depth.has_value()) {
+        clang_getInclusions(unit, Job::include_depth_visitor, this);
+    }
+
+    CXCursor cursor = clang_getTranslationUnitCursor(unit);
+
+    clang_visitChildren(cursor, // Root cursor
+                        Job::top_level_cursor_visitor,
+                        this // userdata
+    );
+
+    finish_translation_unit(unit);
+}
+
+std::span<CXUnsavedFile>
+ClangToGraphMLBuilder::Job::unsaved_files(const char* filename)
+{
+    if (scratch->unity_source.empty()) {
+        return {};
+    }
+    scratch->unity_file = {
+        .Filename = filename,
+        .Contents = scratch->unity_source.c_str(),
+        .Length = static_cast<unsigned long>(scratch->unity_source.size()),
+    };
+    return {&scratch->unity_file, 1};
+}
+
+void ClangToGraphMLBuilder::Job::report_diagnostics(CXTranslationUnit unit,
+                                                    const char* filename)
+{
     // warn for diagnostics
     CXDiagnosticSet diagnostics = clang_getDiagnosticSetFromTU(unit);
     const size_t num_diagnostic = clang_getNumDiagnostics(unit);
     for (size_t i = 0; i < num_diagnostic; ++i) {
-        CXDiagnostic diagnostic = clang_getDiagnosticInSet(diagnostic, i);
+        CXDiagnostic diagnostic = clang_getDiagnosticInSet(diagnostics, i);
 
         std::ignore = fprintf(
             stderr, "DIAGNOSTIC - Encountered while parsing %s: %s\n", filename,
@@ -182,79 +453,353 @@ void ClangToGraphMLBuilder::Job::run(
                 CXDiagnosticDisplayOptions::CXDiagnostic_DisplaySourceLocation)
                 .c_str());
     }
+    clang_disposeDiagnosticSet(diagnostics);
+}
 
-    CXCursor cursor = clang_getTranslationUnitCursor(unit);
+void ClangToGraphMLBuilder::Job::finish_translation_unit(CXTranslationUnit unit)
+{
+    // a body can queue more bodies, of callees nobody had found yet
+    while (!scratch->queued_bodies.empty()) {
+        const auto [function, definition] = scratch->queued_bodies.back();
+        scratch->queued_bodies.pop_back();
+        function->record_calls(*this, definition);
+    }
 
-    clang_visitChildren(cursor, // Root cursor
-                        Job::top_level_cursor_visitor,
-                        this // userdata
-    );
+    if (shared_data->fragment_cache.has_value()) {
+        // a fragment has to stand on its own, since the job which indexed a
+        // header may be loaded from the cache next time or not run at all. so
+        // with the cache on, every job walks every header it includes
+        if (cache_key.has_value()) {
+            record_dependencies(unit);
+        }
+    } else {
+        shared_data->indexed_files.insert(indexed_headers(unit));
+    }
+
+    // cursors and files are invalid once the translation unit is gone
+    scratch->walked_namespace_blocks.clear();
+    scratch->status_by_file.clear();
+    scratch->include_depth_by_file.clear();
+    scratch->call_index_by_callee.clear();
 
     clang_disposeTranslationUnit(unit);
-    clang_disposeIndex(index);
 }
 
-namespace {
-/// Recurse through symbols, adding <edge source="" target=""/> entries and
-/// <node id= ""/> entries for each depth first
-void symbol_recursive_visitor(Symbol* symbol, pugi::xml_node& graph_node)
+void ClangToGraphMLBuilder::Job::inclusion_visitor(
+    CXFile included_file, CXSourceLocation* /*inclusion_stack*/,
+    unsigned include_len, CXClientData client_data)
 {
-    if (symbol->serialized) {
+    // the main file has an empty include stack, it is not a header
+    if (include_len == 0) {
         return;
     }
-    symbol->serialized = true;
+    static_cast<std::pmr::vector<CXFile>*>(client_data)
+        ->push_back(included_file);
+}
 
-    graph_node.append_child("node").append_attribute("id").set_value(
-        symbol->display_name);
+std::pmr::vector<CXFileUniqueID>
+ClangToGraphMLBuilder::Job::indexed_headers(CXTranslationUnit unit)
+{
+    std::pmr::vector<CXFile> included_files{scratch->allocator};
+    clang_getInclusions(unit, Job::inclusion_visitor, &included_files);
+
+    std::pmr::vector<CXFileUniqueID> out{scratch->allocator};
+    out.reserve(included_files.size());
+    for (CXFile file : included_files) {
+        // the system header and include depth filters are decided per
+        // translation unit, so a header left out of this one may be in scope
+        // for the next. and a header we never saw a declaration from has
+        // nothing to skip anyways
+        auto status = scratch->status_by_file.find(file);
+        if (status == scratch->status_by_file.end() ||
+            status->second.out_of_scope) {
+            continue;
+        }
+        CXFileUniqueID id{};
+        if (clang_getFileUniqueID(file, &id) == 0) {
+            out.push_back(id);
+        }
+    }
+    return out;
+}
 
-    const size_t num_children = symbol->get_num_symbols_this_references();
-    for (size_t i = 0; i < num_children; ++i) {
-        Symbol* target = symbol->get_symbol_this_references(i);
-        assert(target != symbol);
-        auto node = graph_node.append_child("edge");
-        node.append_attribute("source").set_value(symbol->display_name);
-        symbol_recursive_visitor(target, graph_node);
-        node.append_attribute("target").set_value(target->display_name);
+void ClangToGraphMLBuilder::Job::record_dependencies(CXTranslationUnit unit)
+{
+    std::vector<std::string> paths;
+    clang_getInclusions(
+        unit,
+        [](CXFile included_file, CXSourceLocation* /*inclusion_stack*/,
+           unsigned include_len, CXClientData client_data) {
+            if (include_len != 0) {
+                static_cast<std::vector<std::string>*>(client_data)
+                    ->emplace_back(
+                        OwningCXString::clang_getFileName(included_file)
+                            .c_str());
+            }
+        },
+        &paths);
+
+    dependencies.reserve(paths.size());
+    for (auto& path : paths) {
+        auto hash = shared_data->fragment_cache->hash_file(path);
+        if (!hash.has_value()) {
+            // generated header that is already gone or similar, there is no
+            // way to know if the fragment is still valid later
+            std::ignore = fprintf(
+                stderr, "Unable to read %s, not caching %s\n", path.c_str(),
+                main_file.c_str());
+            cache_key.reset();
+            return;
+        }
+        dependencies.push_back(FragmentDependency{
+            .path = std::move(path),
+            .content_hash = hash.value(),
+        });
     }
 }
+
+void ClangToGraphMLBuilder::Job::include_depth_visitor(
+    CXFile included_file, CXSourceLocation* /*inclusion_stack*/,
+    unsigned include_len, CXClientData client_data)
+{
+    auto* job = static_cast<Job*>(client_data);
+    const unsigned depth =
+        include_len - std::min(include_len, job->main_file_depth());
+    // a header included from several places is as deep as its shallowest
+    // inclusion
+    auto [iter, inserted] =
+        job->scratch->include_depth_by_file.try_emplace(included_file, depth);
+    iter->second = std::min(iter->second, depth);
+}
+
+const ClangToGraphMLBuilder::Job::FileStatus&
+ClangToGraphMLBuilder::Job::file_status(const CXCursor& cursor)
+{
+    const CXSourceLocation location = clang_getCursorLocation(cursor);
+    CXFile file = nullptr;
+    clang_getExpansionLocation(location, &file, nullptr, nullptr, nullptr);
+
+    auto [iter, inserted] = scratch->status_by_file.try_emplace(file);
+    if (!inserted) {
+        return iter->second;
+    }
+
+    const BuilderOptions& options = shared_data->options;
+    FileStatus& status = iter->second;
+
+    // builtins like __va_list_tag have no file, and only count as system
+    if (file == nullptr) {
+        status = {.indexed = false, .out_of_scope = options.no_system_headers};
+        return status;
+    }
+
+    CXFileUniqueID id{};
+    status.indexed = clang_getFileUniqueID(file, &id) == 0 &&
+                     shared_data->indexed_files.contains(id);
+
+    if (options.no_system_headers &&
+        clang_Location_isInSystemHeader(location) != 0) {
+        status.out_of_scope = true;
+        return status;
+    }
+
+    if (options.max_include_depth.has_value()) {
+        // files we have no depth for were not #included, like the main file
+        auto depth = scratch->include_depth_by_file.find(file);
+        if (depth != scratch->include_depth_by_file.end() &&
+            depth->second > options.max_include_depth.value()) {
+            status.out_of_scope = true;
+            return status;
+        }
+    }
+
+    if (options.include_paths.empty() && options.exclude_paths.empty()) {
+        return status;
+    }
+
+    auto path = OwningCXString(clang_File_tryGetRealPathName(file));
+    if (path.view().empty()) {
+        path = OwningCXString::clang_getFileName(file);
+    }
+
+    const auto matches = [&path](const std::string& glob) {
+        return fnmatch(glob.c_str(), path.c_str(), 0) == 0;
+    };
+
+    status.out_of_scope =
+        (!options.include_paths.empty() &&
+         std::ranges::none_of(options.include_paths, matches)) ||
+        std::ranges::any_of(options.exclude_paths, matches);
+    return status;
+}
+
+namespace {
+/// Lowers every symbol into a Graph. symbols[i] becomes node i, so the root
+/// has to come first, and the rest have to be sorted by USR
+Graph lower_symbols(std::span<Symbol* const> symbols, const UsrInterner& usrs,
+                    std::pmr::polymorphic_allocator<> allocator)
+{
+    Graph graph{allocator};
+
+    std::pmr::unordered_map<const Symbol*, NodeId> id_by_symbol{allocator};
+    id_by_symbol.reserve(symbols.size());
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        id_by_symbol.emplace(symbols[i], static_cast<NodeId>(i));
+    }
+    const auto id_of = [&id_by_symbol](const Symbol* symbol) {
+        auto iter = id_by_symbol.find(symbol);
+        return iter == id_by_symbol.end() ? no_node : iter->second;
+    };
+
+    // lots of symbols share a name, like constructors and operator=
+    std::pmr::unordered_map<std::string_view, uint32_t> name_id_by_name{
+        allocator};
+
+    graph.kinds.reserve(symbols.size());
+    graph.parents.reserve(symbols.size());
+    graph.name_ids.reserve(symbols.size());
+    for (const Symbol* symbol : symbols) {
+        graph.kinds.push_back(symbol->symbol_kind);
+        graph.parents.push_back(symbol->semantic_parent == nullptr
+                                    ? no_node
+                                    : id_of(symbol->semantic_parent));
+        auto [iter, inserted] = name_id_by_name.try_emplace(symbol->name, 0);
+        if (inserted) {
+            iter->second = graph.add_name(symbol->name);
+        }
+        graph.name_ids.push_back(iter->second);
+        graph.add_usr(usrs.view(symbol->usr));
+    }
+
+    // a type used by twenty fields is twenty references but only one edge, so
+    // references are collapsed by target and kind, with their weights added
+    // up. latest_edge_to[target] is the last edge made to target, and
+    // earlier_edge_to chains each edge to the one before it with the same
+    // target. anything before the current symbol's first edge is stale, so
+    // neither needs clearing between symbols
+    constexpr uint32_t no_edge = std::numeric_limits<uint32_t>::max();
+    std::pmr::vector<uint32_t> latest_edge_to(symbols.size(), no_edge,
+                                              allocator);
+    std::pmr::vector<uint32_t> earlier_edge_to{allocator};
+
+    std::pmr::vector<Reference> references{allocator};
+    graph.edge_offsets.reserve(symbols.size() + 1);
+    graph.edge_offsets.push_back(0);
+    for (const Symbol* symbol : symbols) {
+        references.clear();
+        symbol->append_references(references);
+        const uint32_t first_edge = graph.edge_offsets.back();
+        for (const Reference& reference : references) {
+            // symbols which no translation unit had in scope have no node,
+            // and neither do references to them
+            const NodeId target = id_of(reference.target);
+            if (target == no_node) {
+                continue;
+            }
+
+            uint32_t latest = latest_edge_to[target];
+            if (latest < first_edge) {
+                latest = no_edge;
+            }
+            // at most one edge of each kind, so the chain is short
+            uint32_t edge = latest;
+            while (edge != no_edge &&
+                   graph.edge_kinds[edge] != reference.kind) {
+                edge = earlier_edge_to[edge];
+            }
+            if (edge != no_edge) {
+                graph.edge_weights[edge] += reference.weight;
+                continue;
+            }
+
+            latest_edge_to[target] =
+                static_cast<uint32_t>(graph.edge_targets.size());
+            earlier_edge_to.push_back(latest);
+            graph.edge_targets.push_back(target);
+            graph.edge_kinds.push_back(reference.kind);
+            graph.edge_weights.push_back(reference.weight);
+        }
+        assert(graph.edge_targets.size() <
+               std::numeric_limits<uint32_t>::max());
+        graph.edge_offsets.push_back(
+            static_cast<uint32_t>(graph.edge_targets.size()));
+    }
+
+    graph.build_reverse_edges();
+    return graph;
+}
 } // namespace
 
-bool ClangToGraphMLBuilder::finish(std::ostream& output) noexcept
+bool ClangToGraphMLBuilder::finish(const GraphOutputs& outputs) noexcept
 {
-    // function created mostly by following
-    // http://graphml.graphdrawing.org/primer/graphml-primer.html
-    pugi::xml_document doc;
-
-    pugi::xml_node root = doc.append_child();
-
-    /// rootmost element looks like this:
-    /// <graphml xmlns="http://graphml.graphdrawing.org/xmlns"
-    /// xmlns:xsi="http://www.w3.org/2001/XMLSchema-instance"
-    /// xsi:schemaLocation="http://graphml.graphdrawing.org/xmlns
-    /// http://graphml.graphdrawing.org/xmlns/1.0/graphml.xsd">
-    ///</graphml>
-
-    root.set_name("graphml");
-    root.append_attribute("xmlns").set_value(
-        "http://graphml.graphdrawing.org/xmlns");
-    root.append_attribute("xmlns:xsi")
-        .set_value("http://www.w3.org/2001/XMLSchema-instance");
-    root.append_attribute("xsi:schemaLocation")
-        .set_value("http://graphml.graphdrawing.org/xmlns "
-                   "http://graphml.graphdrawing.org/xmlns/1.0/graphml.xsd");
-
-    pugi::xml_node graph = root.append_child("graph");
-    graph.append_attribute("id").set_value("G");
-    graph.append_attribute("edgedefault").set_value("directed");
-
-    // for display purposes, also i think an empty id is invalid
-    this->m_data->global_namespace.display_name = "GLOBAL_NAMESPACE";
-
-    // add all nodes and edges
-    symbol_recursive_visitor(&this->m_data->global_namespace, graph);
-
-    doc.save(output);
-    return true;
+    m_pool->join();
+
+    if (m_data->fragment_cache.has_value()) {
+        for (size_t i = 0; i < m_data->finished_jobs.size(); ++i) {
+            Job* job = m_data->finished_jobs.at(i);
+            if (!job->loaded_from_cache && job->cache_key.has_value()) {
+                job->save_fragment();
+            }
+        }
+    }
+
+    // nothing looks at the jobs past this point, give their memory back for
+    // the output
+    for (size_t i = 0; i < m_data->finished_jobs.size(); ++i) {
+        m_data->allocator.delete_object(m_data->finished_jobs.at(i));
+    }
+
+    // namespace contents are gathered here rather than while parsing, in USR
+    // order, so that the output is the same regardless of how many jobs ran
+    // or which of them saw a namespace first
+    std::pmr::vector<Symbol*> all_symbols{m_data->allocator};
+    m_data->symbols_by_usr.for_each(
+        [&all_symbols](Symbol* symbol) { all_symbols.push_back(symbol); });
+    std::ranges::sort(all_symbols, {}, [this](const Symbol* symbol) {
+        return m_data->usrs.view(symbol->usr);
+    });
+
+    // only what some translation unit had in scope goes into the graph, along
+    // with everything it is declared inside of. a parent already marked is
+    // either marked along with its own parents already, or gets to them when
+    // the loop reaches it
+    for (Symbol* symbol : all_symbols) {
+        if (!symbol->in_scope.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        Symbol* parent = symbol->semantic_parent;
+        while (parent != nullptr &&
+               !parent->in_scope.exchange(true, std::memory_order_relaxed)) {
+            parent = parent->semantic_parent;
+        }
+    }
+    std::erase_if(all_symbols, [](const Symbol* symbol) {
+        return !symbol->in_scope.load(std::memory_order_relaxed);
+    });
+
+    for (Symbol* symbol : all_symbols) {
+        if (symbol->semantic_parent == nullptr) {
+            m_data->global_namespace.symbols.emplace_back(symbol);
+        } else if (auto* parent =
+                       symbol->semantic_parent->upcast<NamespaceSymbol>()) {
+            parent->symbols.emplace_back(symbol);
+        }
+    }
+
+    // for display purposes, the root would otherwise have an empty name
+    this->m_data->global_namespace.name = "GLOBAL_NAMESPACE";
+
+    // nothing past here needs the symbols themselves
+    all_symbols.insert(all_symbols.begin(), &m_data->global_namespace);
+    const Graph lowered =
+        lower_symbols(all_symbols, m_data->usrs, m_data->allocator);
+    const GraphView view = lowered.view();
+
+    if (outputs.binary != nullptr && !write_graph_file(view, *outputs.binary)) {
+        return false;
+    }
+    return outputs.graphml == nullptr ||
+           write_graphml(view, *outputs.graphml, m_data->options.num_jobs);
 }
 
 } // namespace cn
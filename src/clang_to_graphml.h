@@ -1,37 +1,120 @@
 #ifndef __CODENODES_CLANG_TO_GRAPHML_H__
 #define __CODENODES_CLANG_TO_GRAPHML_H__
 
+#include <cstdint>
 #include <memory_resource>
+#include <optional>
 #include <ostream>
 #include <span>
+#include <string>
+#include <vector>
 
 namespace cn {
+/// How declarations are found in each translation unit
+enum class ExtractionEngine : uint8_t
+{
+    /// recursive clang_visitChildren walk from the translation unit cursor
+    Visitor,
+    /// clang_indexSourceFile callbacks, which come with USRs already computed
+    /// and skip function bodies that were already parsed by the same worker
+    Indexer,
+};
+
+/// How much of each translation unit is parsed, and so what ends up in the
+/// graph. Each level includes everything from the ones before it
+enum class ParseDepth : uint8_t
+{
+    /// namespaces, classes, functions and enums, and what contains what.
+    /// function bodies are skipped and templates are not instantiated
+    Declarations,
+    /// also field types, base classes, and function parameter and return
+    /// types. function bodies are skipped
+    Signatures,
+    /// function bodies are fully parsed and semantically analyzed, and every
+    /// call in them becomes an edge
+    Bodies,
+};
+
+struct BuilderOptions
+{
+    /// number of worker threads parsing translation units. If it is 1, every
+    /// call to parse() runs to completion before returning.
+    size_t num_jobs = 1;
+    ExtractionEngine engine = ExtractionEngine::Visitor;
+    ParseDepth depth = ParseDepth::Bodies;
+    /// directory to keep a fragment of the graph per translation unit in, so
+    /// that unchanged translation units are not parsed again next run. Off if
+    /// empty
+    std::string cache_directory;
+
+    /// fnmatch globs, matched against the real path of each file. If any are
+    /// given, declarations in files which match none of them are ignored
+    std::vector<std::string> include_paths;
+    /// declarations in files which match any of these are ignored
+    std::vector<std::string> exclude_paths;
+    bool no_system_headers = false;
+    /// declarations in files included through more than this many nested
+    /// #includes are ignored. The main file has a depth of 0. Like whether a
+    /// header is a system header, this can differ between translation units,
+    /// and a header is kept if any translation unit has it in scope
+    std::optional<unsigned> max_include_depth;
+
+    /// translation units with identical arguments are parsed together, this
+    /// many at a time, as one generated source which #includes each of them.
+    /// Saves parsing their shared headers again, at the cost of each member
+    /// seeing the macros and static declarations of the ones before it. Unity
+    /// batches are not cached. Off if 1 or less
+    size_t unity_batch = 1;
+};
+
+/// Where finish() writes the graph. Either may be left out
+struct GraphOutputs
+{
+    // GraphML XML
+    std::ostream* graphml = nullptr;
+    // the binary format of graph_file.h, opened in binary mode
+    std::ostream* binary = nullptr;
+};
+
 class ClangToGraphMLBuilder
 {
   public:
-    explicit ClangToGraphMLBuilder(std::pmr::memory_resource& memory_resource);
+    explicit ClangToGraphMLBuilder(std::pmr::memory_resource& memory_resource,
+                                   const BuilderOptions& options = {});
     ClangToGraphMLBuilder(const ClangToGraphMLBuilder&) = delete;
     ClangToGraphMLBuilder& operator=(const ClangToGraphMLBuilder&) = delete;
     ClangToGraphMLBuilder(ClangToGraphMLBuilder&&) = delete;
     ClangToGraphMLBuilder& operator=(ClangToGraphMLBuilder&&) = delete;
     ~ClangToGraphMLBuilder();
 
-    /// Add a file to parse along with its commandline arguments
+    /// Add a file to parse along with its commandline arguments, which start
+    /// with the compiler and do not include the file. Both are copied, so they
+    /// do not need to outlive this call. In unity batch mode, the file may not
+    /// be parsed until enough others with the same arguments were added, or
+    /// finish() is called
     void parse(const char* filename,
                std::span<const char* const> command_args) noexcept;
 
     /// If there are undefined symbols, or any given job failed perhaps due to
-    /// compilation errors, this returns false. Otherwise it writes GraphML XML
-    /// to the output stream
-    [[nodiscard]] bool finish(std::ostream& output) noexcept;
+    /// compilation errors, this returns false. Otherwise it writes the graph
+    /// to each of the outputs
+    [[nodiscard]] bool finish(const GraphOutputs& outputs) noexcept;
+
+    /// Same as above, with GraphML XML as the only output
+    [[nodiscard]] bool finish(std::ostream& output) noexcept
+    {
+        return finish(GraphOutputs{.graphml = &output});
+    }
 
     struct Job;
     struct PersistentData;
+    struct WorkerPool;
 
   private:
     std::pmr::polymorphic_allocator<> m_allocator;
     // data that persists between calls to parse
     PersistentData* m_data;
+    WorkerPool* m_pool;
 };
 
 } // namespace cn
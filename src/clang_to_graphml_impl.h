@@ -2,16 +2,28 @@
 #define __CODENODES_CLANG_TO_GRAPHML_IMPL_H__
 
 #include "clang_wrapper.h"
+#include "fragment_cache.h"
+#include "indexed_files.h"
 #include "symbol.h"
+#include "symbol_table.h"
+#include "type_table.h"
 #include <cassert>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace cn {
 struct ClangToGraphMLBuilder::PersistentData
 {
-    explicit constexpr PersistentData(std::pmr::memory_resource* resource)
-        : allocator(resource), temp_resource(resource),
-          temp_allocator(&temp_resource)
+    PersistentData(std::pmr::memory_resource* resource,
+                   const BuilderOptions& _options)
+        : options(_options), thread_safe_resource(resource),
+          allocator(&thread_safe_resource)
     {
+        if (!options.cache_directory.empty()) {
+            fragment_cache.emplace(options.cache_directory);
+        }
     }
 
     PersistentData(const PersistentData&) = delete;
@@ -20,35 +32,192 @@ struct ClangToGraphMLBuilder::PersistentData
     PersistentData& operator=(PersistentData&&) = delete;
     ~PersistentData() = default;
 
-    /// For data which lives throughout the whole parse
+    const BuilderOptions options;
+    /// Jobs may run on several threads at once and all allocate from here. The
+    /// upstream resource given to the builder does not need to be thread safe
+    std::pmr::synchronized_pool_resource thread_safe_resource;
+    /// For data which lives throughout the whole parse. Anything only needed
+    /// while parsing one translation unit goes in Job::scratch instead
     std::pmr::polymorphic_allocator<> allocator;
-    std::pmr::monotonic_buffer_resource temp_resource;
-    std::pmr::polymorphic_allocator<> temp_allocator;
+    std::mutex finished_jobs_mutex;
     OrderedCollection<Job*> finished_jobs{allocator};
+    // every USR, so that symbols only need to keep an id
+    UsrInterner usrs{allocator};
     // all symbols by their unique id
-    Map<String, Symbol*> symbols_by_usr{allocator};
+    SymbolTable symbols_by_usr{allocator};
+    // every type any symbol refers to, each stored once
+    TypeTable types{allocator};
+    // headers which no job needs to look at again
+    IndexedFileRegistry indexed_files;
+    std::optional<FragmentCache> fragment_cache;
     // forest of definitions
     NamespaceSymbol global_namespace{
-        allocator, nullptr, String{}, {}, String{}};
+        allocator, nullptr, UsrInterner::empty, {}, String{}};
 };
 
+/// CXTranslationUnit_Flags for parsing at the given depth
+constexpr unsigned translation_unit_flags(ParseDepth depth)
+{
+    switch (depth) {
+    case ParseDepth::Declarations:
+        // nothing we look at needs templates instantiated at the end of the
+        // translation unit, which is what Incomplete skips
+        return CXTranslationUnit_SkipFunctionBodies |
+               CXTranslationUnit_KeepGoing | CXTranslationUnit_Incomplete;
+    case ParseDepth::Signatures:
+        return CXTranslationUnit_SkipFunctionBodies |
+               CXTranslationUnit_KeepGoing;
+    case ParseDepth::Bodies:
+        return CXTranslationUnit_None;
+    }
+    return CXTranslationUnit_None;
+}
+
 struct ClangToGraphMLBuilder::Job
 {
     explicit Job(PersistentData* data) : shared_data(data) {}
 
-    void run(const char* filename,
+    /// Parse with the visitor engine
+    void run(CXIndex index, const char* filename,
              std::span<const char* const> command_args) noexcept;
 
+    /// Parse with the indexer engine, defined in indexer.cpp
+    void run_indexer(CXIndexAction action, const char* filename,
+                     std::span<const char* const> command_args) noexcept;
+
+    /// The unity source as an unsaved file with the given name, or nothing if
+    /// this job parses a regular translation unit
+    [[nodiscard]] std::span<CXUnsavedFile> unsaved_files(const char* filename);
+
+    /// Include depth of the files whose declarations count as being in the
+    /// main file. Unity batch members are #included by the unity source
+    [[nodiscard]] unsigned main_file_depth() const
+    {
+        return scratch->unity_source.empty() ? 0 : 1;
+    }
+
+    /// Fragment cache only. Merge this job's translation unit in from the
+    /// cache instead of parsing it, false if it has no up to date fragment
+    [[nodiscard]] bool load_fragment() noexcept;
+
+    /// Fragment cache only. Call once all jobs are done, so that every symbol
+    /// this job saw has been filled in by whichever job defined it
+    void save_fragment() noexcept;
+
+    static void report_diagnostics(CXTranslationUnit unit,
+                                   const char* filename);
+
+    /// Shared by both engines once all symbols in the translation unit have
+    /// been found. Records the calls in every queued body, then disposes the
+    /// translation unit
+    void finish_translation_unit(CXTranslationUnit unit);
+
     static enum CXChildVisitResult
     top_level_cursor_visitor(CXCursor current_cursor, CXCursor parent,
                              void* userdata);
 
-    // for use with clang_getInclusions... could be useful for eliminating
-    // symbols after a certain inclusion depth
-    // static void inclusion_visitor(CXFile included_file,
-    //                               CXSourceLocation* inclusion_stack,
-    //                               unsigned include_len,
-    //                               CXClientData client_data);
+    /// For use with clang_getInclusions, client_data is a
+    /// std::pmr::vector<CXFile> which collects every header included by the
+    /// translation unit
+    static void inclusion_visitor(CXFile included_file,
+                                  CXSourceLocation* inclusion_stack,
+                                  unsigned include_len,
+                                  CXClientData client_data);
+
+    /// Every header the translation unit included and had in scope, whose
+    /// declarations all have symbols now, so later jobs can skip them
+    [[nodiscard]] std::pmr::vector<CXFileUniqueID>
+    indexed_headers(CXTranslationUnit unit);
+
+    /// Fragment cache only. Hash every header the translation unit included,
+    /// or forget the cache key if one can't be read
+    void record_dependencies(CXTranslationUnit unit);
+
+    /// For use with clang_getInclusions, client_data is the Job. Fills in
+    /// include_depth_by_file
+    static void include_depth_visitor(CXFile included_file,
+                                      CXSourceLocation* inclusion_stack,
+                                      unsigned include_len,
+                                      CXClientData client_data);
+
+    struct FileStatus
+    {
+        // a job that already finished included this file, so every
+        // declaration in it already has a symbol
+        bool indexed;
+        // filtered out by the include/exclude paths, system header, or include
+        // depth options
+        bool out_of_scope;
+    };
+
+    /// Status of the file the cursor is in. Only costs a hash lookup after the
+    /// first cursor from each file
+    [[nodiscard]] const FileStatus& file_status(const CXCursor& cursor);
+
+    /// Declarations out of scope only get symbols when something refers to
+    /// them or is declared inside of them, and their children are not visited
+    [[nodiscard]] bool is_out_of_scope(const CXCursor& cursor)
+    {
+        return file_status(cursor).out_of_scope;
+    }
+
+    /// Whether field, base class, parameter and return types are wanted. If
+    /// not, visitors only look for the declarations that symbols contain
+    [[nodiscard]] bool wants_types() const
+    {
+        return shared_data->options.depth >= ParseDepth::Signatures;
+    }
+
+    /// Whether function bodies are parsed, and so walked for the calls in
+    /// them
+    [[nodiscard]] bool wants_bodies() const
+    {
+        return shared_data->options.depth >= ParseDepth::Bodies;
+    }
+
+    /// Queues the body of the function's definition to have its calls
+    /// recorded, if the translation unit has it in scope and no other job took
+    /// it first. Bodies are walked once every declaration has been visited,
+    /// since each callee may have a body of its own and recursing into those
+    /// would go as deep as the longest chain of calls
+    void queue_calls(FunctionSymbol& symbol, const CXCursor& cursor)
+    {
+        const bool caching = shared_data->fragment_cache.has_value();
+        // only the cache cares about bodies someone else already took
+        if (!caching && symbol.calls_claimed.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        const CXCursor definition = clang_getCursorDefinition(cursor);
+        if (clang_Cursor_isNull(definition) != 0) {
+            return;
+        }
+        if (const auto& status = file_status(definition);
+            status.indexed || status.out_of_scope) {
+            return;
+        }
+        if (caching) {
+            defined_functions.insert(&symbol);
+        }
+        if (!symbol.calls_claimed.exchange(true, std::memory_order_acq_rel)) {
+            scratch->queued_bodies.emplace_back(&symbol, definition);
+        }
+    }
+
+    /// Whether a header is in scope depends on the translation unit including
+    /// it, through its include depth or whether it is a system header, and
+    /// which job gets to a symbol first depends on scheduling. So instead of
+    /// deciding per translation unit whether a symbol is in the graph, this
+    /// is called for every declaration in scope. ClangToGraphMLBuilder::finish
+    /// keeps the symbols it was called for by any translation unit, and their
+    /// parents
+    void mark_in_scope(Symbol& symbol, bool has_definition = false)
+    {
+        symbol.in_scope.store(true, std::memory_order_relaxed);
+        if (shared_data->fragment_cache.has_value()) {
+            touched_symbols[&symbol] |= has_definition;
+        }
+    }
 
     ///  Try to find a cursor with an unknown type. May fail if the cursor is
     ///  not of a type which can be represented by a Symbol
@@ -92,18 +261,20 @@ struct ClangToGraphMLBuilder::Job
         requires(!std::is_same_v<T, Symbol> && std::is_base_of_v<Symbol, T>)
     T& create_or_find_symbol_with_cursor(CXCursor cursor)
     {
-        auto usr = OwningCXString::clang_getCursorUSR(cursor).copy_to_string(
-            shared_data->allocator);
-
-        if (shared_data->symbols_by_usr.contains(usr)) {
-            Symbol* out = shared_data->symbols_by_usr[std::move(usr)];
-            out->try_visit_children(*this, cursor);
-            assert(out->symbol_kind == T::kind);
-            T* upcasted = out->upcast<T>();
-            if (!upcasted) {
-                std::abort(); // release mode safety
-            }
-            return *upcasted;
+        return create_or_find_symbol_with_usr<T>(
+            OwningCXString::clang_getCursorUSR(cursor).view(), cursor);
+    }
+
+    /// Same as create_or_find_symbol_with_cursor, for when the cursor's USR is
+    /// already known
+    template <typename T>
+        requires(!std::is_same_v<T, Symbol> && std::is_base_of_v<Symbol, T>)
+    T& create_or_find_symbol_with_usr(std::string_view usr_view,
+                                      CXCursor cursor)
+    {
+        const UsrId usr = shared_data->usrs.intern(usr_view);
+        if (Symbol* existing = shared_data->symbols_by_usr.find(usr)) {
+            return visit_found_symbol<T>(existing, cursor);
         }
 
         CXCursor semantic_parent_cursor = clang_getCursorSemanticParent(cursor);
@@ -117,41 +288,155 @@ struct ClangToGraphMLBuilder::Job
         semantic_parent = create_or_find_symbol_with_cursor_runtime_known_type(
             semantic_parent_cursor);
 
-        String display_name{shared_data->allocator};
-        if (semantic_parent && !semantic_parent->display_name.empty()) {
-            constexpr std::string_view delimiter = "::";
-            const std::string_view parent_display_name =
-                semantic_parent->display_name;
-            auto our_name = OwningCXString::clang_getCursorDisplayName(cursor);
-            const size_t out_name_length = strlen(our_name.c_str());
-            display_name.reserve(out_name_length + delimiter.size() +
-                                 parent_display_name.size());
-            display_name.append(parent_display_name);
-            display_name.append(delimiter);
-            display_name.append(our_name.c_str(), out_name_length);
-        } else {
-            display_name = OwningCXString::clang_getCursorDisplayName(cursor)
-                               .copy_to_string(shared_data->allocator);
-        }
+        String name = OwningCXString::clang_getCursorDisplayName(cursor)
+                          .copy_to_string(shared_data->allocator);
 
         T* out = shared_data->allocator.new_object<T>(
-            shared_data->allocator, semantic_parent, std::move(usr), cursor,
-            std::move(display_name));
-
-        if (semantic_parent == nullptr) {
-            shared_data->global_namespace.symbols.emplace_back(out);
-        }
+            shared_data->allocator, semantic_parent, usr, cursor,
+            std::move(name));
 
         // NOTE: insert beforehand so that way children can find us when looking
         // for their semantic parent
-        shared_data->symbols_by_usr[out->usr] = out;
+        Symbol* inserted =
+            shared_data->symbols_by_usr.insert_or_get(usr, out);
+
+        if (inserted != out) {
+            // another job created this symbol while we were finding our
+            // semantic parent, ours is never referenced and just leaks into the
+            // arena
+            return visit_found_symbol<T>(inserted, cursor);
+        }
 
-        out->try_visit_children(*this, cursor);
+        visit_children(*out, cursor);
 
         return *out;
     }
 
+    template <typename T>
+        requires(!std::is_same_v<T, Symbol> && std::is_base_of_v<Symbol, T>)
+    T& visit_found_symbol(Symbol* found, CXCursor cursor)
+    {
+        assert(found->symbol_kind == T::kind);
+        T* upcasted = found->upcast<T>();
+        if (!upcasted) {
+            std::abort(); // release mode safety
+        }
+        visit_children(*upcasted, cursor);
+        return *upcasted;
+    }
+
+    template <typename T> void visit_children(T& symbol, CXCursor cursor)
+    {
+        // the definition may be in scope even if this declaration isn't
+        if constexpr (std::is_same_v<T, FunctionSymbol>) {
+            if (wants_bodies()) {
+                queue_calls(symbol, cursor);
+            }
+        }
+
+        // only here as the semantic parent of something in scope, or because
+        // something in scope refers to it
+        if (is_out_of_scope(cursor)) {
+            return;
+        }
+
+        bool has_definition = true;
+        if constexpr (std::is_same_v<T, ClassSymbol>) {
+            if (shared_data->fragment_cache.has_value()) {
+                has_definition =
+                    clang_Cursor_isNull(clang_getCursorDefinition(cursor)) == 0;
+            }
+        }
+        mark_in_scope(symbol, has_definition);
+
+        if constexpr (std::is_same_v<T, NamespaceSymbol>) {
+            // the indexer reports every declaration in a namespace by itself
+            if (shared_data->options.engine == ExtractionEngine::Visitor) {
+                symbol.visit_block(*this, cursor);
+            }
+        } else {
+            symbol.try_visit_children(*this, cursor);
+        }
+    }
+
+    struct CursorHash
+    {
+        size_t operator()(const CXCursor& cursor) const
+        {
+            return clang_hashCursor(cursor);
+        }
+    };
+
+    struct CursorEqual
+    {
+        bool operator()(const CXCursor& lhs, const CXCursor& rhs) const
+        {
+            return clang_equalCursors(lhs, rhs) != 0;
+        }
+    };
+
+    /// Everything that is only needed while a translation unit is parsed.
+    /// Lives in the worker's scratch arena, which is released all at once
+    /// when the job is done, so none of it adds to the size of the graph
+    struct Scratch
+    {
+        explicit Scratch(std::pmr::memory_resource* resource)
+            : allocator(resource), walked_namespace_blocks(resource),
+              status_by_file(resource), include_depth_by_file(resource),
+              unity_source(resource), type_by_clang_type(resource),
+              queued_bodies(resource), calls(resource),
+              call_index_by_callee(resource)
+        {
+        }
+
+        Scratch(const Scratch&) = delete;
+        Scratch& operator=(const Scratch&) = delete;
+        Scratch(Scratch&&) = delete;
+        Scratch& operator=(Scratch&&) = delete;
+        ~Scratch() = default;
+
+        /// For temporaries while parsing
+        std::pmr::polymorphic_allocator<> allocator;
+        // namespace blocks which have already been walked
+        std::pmr::unordered_set<CXCursor, CursorHash, CursorEqual>
+            walked_namespace_blocks;
+        // every file seen so far
+        std::pmr::unordered_map<CXFile, FileStatus> status_by_file;
+        // only filled in if there is a max include depth
+        std::pmr::unordered_map<CXFile, unsigned> include_depth_by_file;
+        // #includes every member of a unity batch, empty for a regular
+        // translation unit
+        std::pmr::string unity_source;
+        CXUnsavedFile unity_file{};
+        // conversions done so far, keyed by the first data pointer of the
+        // canonical CXType, which is all that distinguishes types within one
+        // translation unit
+        std::pmr::unordered_map<const void*, const TypeIdentifier*>
+            type_by_clang_type;
+        // definitions whose calls this job claimed but has not recorded yet
+        std::pmr::vector<std::pair<FunctionSymbol*, CXCursor>> queued_bodies;
+        // calls in the body being walked, and where each callee is in there
+        std::pmr::vector<FunctionSymbol::Call> calls;
+        std::pmr::unordered_map<FunctionSymbol*, uint32_t>
+            call_index_by_callee;
+    };
+
     PersistentData* shared_data;
+    // only while a translation unit is being parsed
+    std::optional<Scratch> scratch;
+
+    // the rest is only used with the fragment cache
+    std::optional<uint64_t> cache_key;
+    std::string main_file;
+    bool loaded_from_cache = false;
+    // every header the translation unit included
+    std::vector<FragmentDependency> dependencies;
+    // every symbol this job had in scope, and whether the translation unit had
+    // its definition
+    std::unordered_map<Symbol*, bool> touched_symbols;
+    // functions whose bodies were in the translation unit, whichever job
+    // recorded their calls
+    std::unordered_set<FunctionSymbol*> defined_functions;
 };
 
 constexpr std::optional<PrimitiveTypeType>
@@ -193,7 +478,7 @@ clang_type_to_primitive_type(const CXType& type)
     }
 }
 
-constexpr TypeIdentifier
+constexpr const TypeIdentifier*
 clang_type_to_type_identifier(ClangToGraphMLBuilder::Job& job,
                               const CXType& type);
 
@@ -252,9 +537,8 @@ clang_type_to_c_array_type_identifier(ClangToGraphMLBuilder::Job& job,
                 clang_type_to_pointer_type_identifier(job, element_type);
             pointer_type) {
             return CArrayTypeIdentifier{
-                .contents_type = job.shared_data->allocator
-                                     .new_object<PointerTypeIdentifier>(
-                                         std::move(pointer_type.value())),
+                .contents_type =
+                    job.shared_data->types.intern(pointer_type.value()),
                 .size = size,
             };
         }
@@ -267,9 +551,8 @@ clang_type_to_c_array_type_identifier(ClangToGraphMLBuilder::Job& job,
                     job, clang_getElementType(element_type));
                 nested_array) {
                 return CArrayTypeIdentifier{
-                    .contents_type = job.shared_data->allocator
-                                         .new_object<CArrayTypeIdentifier>(
-                                             std::move(nested_array.value())),
+                    .contents_type =
+                        job.shared_data->types.intern(nested_array.value()),
                     .size = size,
                 };
             }
@@ -300,7 +583,7 @@ clang_type_to_concrete_type_identifier(ClangToGraphMLBuilder::Job& job,
 
     if (auto carray = clang_type_to_c_array_type_identifier(job, type);
         carray) {
-        return ConcreteTypeIdentifier{std::move(carray.value())};
+        return ConcreteTypeIdentifier{carray.value()};
     }
 
     if (auto user_defined = clang_type_to_user_defined_type(job, type);
@@ -310,26 +593,25 @@ clang_type_to_concrete_type_identifier(ClangToGraphMLBuilder::Job& job,
     return {};
 }
 
-constexpr PointerTypeIdentifier*
-_clang_type_to_pointer_type_identifier_recursive_allocating(
+constexpr const PointerTypeIdentifier*
+_clang_type_to_pointer_type_identifier_recursive_interned(
     ClangToGraphMLBuilder::Job& job, const CXType& type)
 {
     if (CXType pointee = get_cannonical_type(clang_getPointeeType(type));
         pointee.kind != CXType_Invalid) {
 
-        if (auto* ptr =
-                _clang_type_to_pointer_type_identifier_recursive_allocating(
+        if (const auto* ptr =
+                _clang_type_to_pointer_type_identifier_recursive_interned(
                     job, pointee);
             ptr) {
-            return job.shared_data->allocator.new_object<PointerTypeIdentifier>(
-                ptr);
+            return job.shared_data->types.intern(PointerTypeIdentifier{ptr});
         }
 
         if (auto concrete =
                 clang_type_to_concrete_type_identifier(job, pointee);
             concrete) {
-            return job.shared_data->allocator.new_object<PointerTypeIdentifier>(
-                std::move(concrete.value()));
+            return job.shared_data->types.intern(
+                PointerTypeIdentifier{concrete.value()});
         }
 
         std::ignore = std::fprintf(
@@ -346,8 +628,8 @@ clang_type_to_pointer_type_identifier(ClangToGraphMLBuilder::Job& job,
     if (CXType pointee = get_cannonical_type(clang_getPointeeType(type));
         pointee.kind != CXType_Invalid) {
 
-        if (auto* ptr =
-                _clang_type_to_pointer_type_identifier_recursive_allocating(
+        if (const auto* ptr =
+                _clang_type_to_pointer_type_identifier_recursive_interned(
                     job, pointee);
             ptr) {
             return PointerTypeIdentifier{ptr};
@@ -356,23 +638,23 @@ clang_type_to_pointer_type_identifier(ClangToGraphMLBuilder::Job& job,
         if (auto concrete =
                 clang_type_to_concrete_type_identifier(job, pointee);
             concrete) {
-            return PointerTypeIdentifier{std::move(concrete.value())};
+            return PointerTypeIdentifier{concrete.value()};
         }
 
         if (pointee.kind == CXType_FunctionProto) {
             int num_args = clang_getNumArgTypes(pointee);
-            OrderedCollection<TypeIdentifier> arg_types{
-                job.shared_data->allocator};
-            arg_types.reserve(num_args);
+            std::pmr::vector<const TypeIdentifier*> arg_types{
+                job.scratch->allocator};
+            arg_types.reserve(num_args + 1);
             for (int i = 0; i < num_args; ++i) {
-                arg_types.emplace_back(clang_type_to_type_identifier(
+                arg_types.push_back(clang_type_to_type_identifier(
                     job, clang_getArgType(pointee, i)));
             }
 
-            arg_types.emplace_back(clang_type_to_type_identifier(
+            arg_types.push_back(clang_type_to_type_identifier(
                 job, clang_getResultType(pointee)));
-            return PointerTypeIdentifier{
-                FunctionProtoTypeIdentifier{std::move(arg_types)}};
+            return PointerTypeIdentifier{FunctionProtoTypeIdentifier{
+                job.shared_data->types.intern(arg_types)}};
         }
 
         std::ignore = std::fprintf(
@@ -388,11 +670,11 @@ clang_type_to_nonreference_type_identifier(ClangToGraphMLBuilder::Job& job,
 {
     if (auto concrete = clang_type_to_concrete_type_identifier(job, type);
         concrete) {
-        return NonReferenceTypeIdentifier{std::move(concrete.value())};
+        return NonReferenceTypeIdentifier{concrete.value()};
     }
     if (auto pointer = clang_type_to_pointer_type_identifier(job, type);
         pointer) {
-        return NonReferenceTypeIdentifier{std::move(pointer.value())};
+        return NonReferenceTypeIdentifier{pointer.value()};
     }
     return {};
 }
@@ -423,7 +705,7 @@ clang_type_to_reference_type_identifier(ClangToGraphMLBuilder::Job& job,
         return ReferenceTypeIdentifier{
             .is_const = is_const,
             .kind = kind,
-            .referenced_type = std::move(nonref.value()),
+            .referenced_type = nonref.value(),
         };
     }
 
@@ -441,15 +723,15 @@ clang_type_to_reference_type_identifier(ClangToGraphMLBuilder::Job& job,
 }
 
 constexpr TypeIdentifier
-clang_type_to_type_identifier(ClangToGraphMLBuilder::Job& job,
-                              const CXType& type)
+_clang_type_to_type_identifier_uncached(ClangToGraphMLBuilder::Job& job,
+                                        const CXType& type)
 {
     if (auto nonref = clang_type_to_nonreference_type_identifier(job, type);
         nonref) {
-        return TypeIdentifier{std::move(nonref.value())};
+        return TypeIdentifier{nonref.value()};
     }
     if (auto ref = clang_type_to_reference_type_identifier(job, type); ref) {
-        return TypeIdentifier{std::move(ref.value())};
+        return TypeIdentifier{ref.value()};
     }
 
     std::ignore =
@@ -462,6 +744,24 @@ clang_type_to_type_identifier(ClangToGraphMLBuilder::Job& job,
         ConcreteTypeIdentifier{PrimitiveTypeType::Int32}}};
 }
 
+/// Interned, so converting the same type twice gives the same pointer. Each
+/// type is only converted once per translation unit
+constexpr const TypeIdentifier*
+clang_type_to_type_identifier(ClangToGraphMLBuilder::Job& job,
+                              const CXType& input_type)
+{
+    const CXType type = get_cannonical_type(input_type);
+    auto& memo = job.scratch->type_by_clang_type;
+    if (auto iter = memo.find(type.data[0]); iter != memo.end()) {
+        return iter->second;
+    }
+
+    const TypeIdentifier* out = job.shared_data->types.intern(
+        _clang_type_to_type_identifier_uncached(job, type));
+    memo.emplace(type.data[0], out);
+    return out;
+}
+
 } // namespace cn
 
 #endif
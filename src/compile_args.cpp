@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <array>
+#include <filesystem>
+
+#include "compile_args.h"
+
+namespace cn {
+
+namespace {
+/// Flags whose next argument is a path
+constexpr auto path_flags = std::to_array<std::string_view>({
+    "-I",
+    "-F",
+    "-isystem",
+    "-iquote",
+    "-idirafter",
+    "-iframework",
+    "-include",
+    "-imacros",
+    "-include-pch",
+    "-isysroot",
+    "--sysroot",
+});
+
+/// Flags which can have their path directly attached, like -Iinclude. Checked
+/// after path_flags, so -isysroot is never mistaken for -isystem
+constexpr auto joined_path_flags = std::to_array<std::string_view>({
+    "-isystem",
+    "-iquote",
+    "-idirafter",
+    "-iframework",
+    "--sysroot=",
+    "-I",
+    "-F",
+});
+
+/// Flags whose next argument is passed through untouched, even if it looks like
+/// a flag we would drop
+constexpr auto verbatim_value_flags = std::to_array<std::string_view>({
+    "-Xclang",
+    "-Xpreprocessor",
+    "-mllvm",
+    "-D",
+    "-U",
+    "-x",
+    "-target",
+});
+
+/// Flags which only matter for the compiler's output, and the path after them
+constexpr auto dropped_flags_with_value = std::to_array<std::string_view>({
+    "-o",
+    "-MF",
+    "-MT",
+    "-MQ",
+    "-MJ",
+});
+
+template <size_t N>
+bool contains(const std::array<std::string_view, N>& flags,
+              std::string_view arg)
+{
+    return std::ranges::find(flags, arg) != flags.end();
+}
+
+bool is_dropped(std::string_view arg)
+{
+    // -M* writes dependency files, -W* only changes which diagnostics we get
+    // and we don't act on them anyways, except -Wp, which passes options like
+    // -D on to the preprocessor. -o is also output, but there are -objc flags
+    // that start with it
+    return arg == "-c" || arg.starts_with("-M") ||
+           (arg.starts_with("-W") && !arg.starts_with("-Wp,")) ||
+           (arg.starts_with("-o") && !arg.starts_with("-obj"));
+}
+
+void append_path(std::string_view path, std::string_view directory,
+                 std::string& out)
+{
+    const std::filesystem::path as_path{path};
+    if (directory.empty() || path.empty() || as_path.is_absolute()) {
+        out.append(path);
+    } else {
+        out.append((std::filesystem::path{directory} / as_path)
+                       .lexically_normal()
+                       .native());
+    }
+}
+} // namespace
+
+void tokenize_command(std::string_view command, std::string& out)
+{
+    bool in_token = false;
+    char quote = '\0';
+
+    for (size_t i = 0; i < command.size(); ++i) {
+        const char character = command[i];
+
+        if (quote == '\'') {
+            // nothing is special inside single quotes
+            if (character == '\'') {
+                quote = '\0';
+            } else {
+                out.push_back(character);
+            }
+            continue;
+        }
+
+        if (quote == '"') {
+            if (character == '"') {
+                quote = '\0';
+            } else if (character == '\\' && i + 1 < command.size() &&
+                       std::string_view{"\"\\$`"}.contains(command[i + 1])) {
+                out.push_back(command[++i]);
+            } else {
+                out.push_back(character);
+            }
+            continue;
+        }
+
+        switch (character) {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            if (in_token) {
+                out.push_back('\0');
+                in_token = false;
+            }
+            break;
+        case '\'':
+        case '"':
+            // "" is still an argument, just an empty one
+            quote = character;
+            in_token = true;
+            break;
+        case '\\':
+            if (i + 1 < command.size()) {
+                out.push_back(command[++i]);
+            }
+            in_token = true;
+            break;
+        default:
+            out.push_back(character);
+            in_token = true;
+            break;
+        }
+    }
+
+    if (in_token) {
+        out.push_back('\0');
+    }
+}
+
+CompileCommand CompileArgsTable::add(const CompileCommandEntry& entry)
+{
+    CompileCommand out;
+    append_path(entry.file, entry.directory, out.file);
+
+    m_tokens.clear();
+    if (entry.arguments.empty()) {
+        tokenize_command(entry.command, m_tokens);
+    } else {
+        for (const auto& argument : entry.arguments) {
+            m_tokens.append(argument);
+            m_tokens.push_back('\0');
+        }
+    }
+
+    m_normalized.clear();
+    std::string resolved_arg;
+    bool next_is_path = false;
+    bool next_is_verbatim = false;
+    bool skip_next = false;
+    bool is_compiler = true;
+
+    for (size_t begin = 0; begin < m_tokens.size();) {
+        const size_t end = m_tokens.find('\0', begin);
+        const std::string_view arg{m_tokens.data() + begin, end - begin};
+        begin = end + 1;
+
+        if (is_compiler) {
+            // keep the compiler as it is, it's only there as argv[0]
+            m_normalized.append(arg);
+            m_normalized.push_back('\0');
+            is_compiler = false;
+            continue;
+        }
+
+        if (skip_next) {
+            skip_next = false;
+            continue;
+        }
+
+        if (next_is_path) {
+            append_path(arg, entry.directory, m_normalized);
+            m_normalized.push_back('\0');
+            next_is_path = false;
+            continue;
+        }
+
+        if (next_is_verbatim || contains(verbatim_value_flags, arg)) {
+            next_is_verbatim = !next_is_verbatim;
+            m_normalized.append(arg);
+            m_normalized.push_back('\0');
+            continue;
+        }
+
+        if (contains(dropped_flags_with_value, arg)) {
+            skip_next = true;
+            continue;
+        }
+
+        if (is_dropped(arg)) {
+            continue;
+        }
+
+        if (contains(path_flags, arg)) {
+            next_is_path = true;
+            m_normalized.append(arg);
+            m_normalized.push_back('\0');
+            continue;
+        }
+
+        if (arg.starts_with('@')) {
+            // response file
+            m_normalized.push_back('@');
+            append_path(arg.substr(1), entry.directory, m_normalized);
+            m_normalized.push_back('\0');
+            continue;
+        }
+
+        if (auto flag = std::ranges::find_if(joined_path_flags,
+                                             [arg](std::string_view flag) {
+                                                 return arg.starts_with(flag);
+                                             });
+            flag != joined_path_flags.end()) {
+            m_normalized.append(*flag);
+            append_path(arg.substr(flag->size()), entry.directory,
+                        m_normalized);
+            m_normalized.push_back('\0');
+            continue;
+        }
+
+        if (!arg.starts_with('-')) {
+            // the source file is passed to clang separately
+            resolved_arg.clear();
+            append_path(arg, entry.directory, resolved_arg);
+            if (resolved_arg == out.file) {
+                continue;
+            }
+        }
+
+        m_normalized.append(arg);
+        m_normalized.push_back('\0');
+    }
+
+    if (auto iter = m_by_buffer.find(m_normalized); iter != m_by_buffer.end()) {
+        out.args = iter->second->pointers;
+        return out;
+    }
+
+    Interned& interned = m_interned.emplace_back();
+    interned.buffer = m_normalized;
+    for (size_t begin = 0; begin < interned.buffer.size();) {
+        interned.pointers.push_back(interned.buffer.data() + begin);
+        begin = interned.buffer.find('\0', begin) + 1;
+    }
+    m_by_buffer.emplace(interned.buffer, &interned);
+
+    out.args = interned.pointers;
+    return out;
+}
+
+} // namespace cn
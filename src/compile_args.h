@@ -0,0 +1,69 @@
+#ifndef __CODENODES_COMPILE_ARGS_H__
+#define __CODENODES_COMPILE_ARGS_H__
+
+#include <deque>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "compile_command_entry.h"
+
+namespace cn {
+
+/// A compile command ready to be handed to clang
+struct CompileCommand
+{
+    /// absolute path of the source file
+    std::string file;
+    /// the compiler followed by the flags which affect parsing, with every
+    /// path made absolute. Does not include the source file, so commands with
+    /// the same flags share the same args
+    std::span<const char* const> args;
+};
+
+/// Split a command line the way a POSIX shell would, handling quotes and
+/// backslash escapes. Each argument is appended to out followed by a null
+/// terminator
+void tokenize_command(std::string_view command, std::string& out);
+
+/// Turns compile_commands.json entries into CompileCommands, and owns the
+/// memory for their arguments. Identical argument lists are only stored once.
+class CompileArgsTable
+{
+  public:
+    CompileArgsTable() = default;
+    CompileArgsTable(const CompileArgsTable&) = delete;
+    CompileArgsTable& operator=(const CompileArgsTable&) = delete;
+    CompileArgsTable(CompileArgsTable&&) = delete;
+    CompileArgsTable& operator=(CompileArgsTable&&) = delete;
+    ~CompileArgsTable() = default;
+
+    /// The returned args live as long as the table. Output, dependency file
+    /// and warning flags are dropped, and -c
+    [[nodiscard]] CompileCommand add(const CompileCommandEntry& entry);
+
+    /// Number of distinct argument lists added so far
+    [[nodiscard]] size_t size() const noexcept { return m_interned.size(); }
+
+  private:
+    struct Interned
+    {
+        // every argument, each followed by a null terminator
+        std::string buffer;
+        std::vector<const char*> pointers;
+    };
+
+    // deque so that pointers into it stay valid
+    std::deque<Interned> m_interned;
+    std::unordered_map<std::string_view, const Interned*> m_by_buffer;
+    // reused between calls to add, so that flags which were already interned
+    // cost no allocations
+    std::string m_tokens;
+    std::string m_normalized;
+};
+
+} // namespace cn
+
+#endif
@@ -1,81 +1,430 @@
-#include <glaze/glaze.hpp>
-#include <print>
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <tuple>
+#include <vector>
 
 #include "compile_command_entry.h"
+#include "mapped_file.h"
 
-static_assert(glz::reflectable<cn::CompileCommandEntry>);
 namespace cn {
 
-std::optional<std::vector<CompileCommandEntry>>
-parse_compile_commands_json_file(const std::string_view& file) noexcept
+namespace {
+/// Just enough of a JSON parser for compile_commands.json, an array of objects
+/// with string or array of string values. Anything else is skipped over.
+class CompileCommandsParser
 {
-    // read entire file into string
-    std::vector<CompileCommandEntry> compile_commands;
+  public:
+    explicit CompileCommandsParser(std::string_view json) : m_json(json) {}
+
+    bool parse(const std::function<void(const CompileCommandEntry&)>& on_entry)
     {
-        std::string buffer{};
-        // about a million bytes
-        buffer.reserve(1024UL * 1024UL);
-        auto read_err = glz::read_file_json(compile_commands, file, buffer);
+        skip_whitespace();
+        if (!expect('[')) {
+            return false;
+        }
+        skip_whitespace();
+        if (consume(']')) {
+            return expect_end();
+        }
 
-        if (read_err) {
-            std::println(stderr, "Error parsing compile commands: {}",
-                         glz::format_error(read_err, buffer));
-            return {};
+        CompileCommandEntry entry;
+        while (true) {
+            m_num_unescaped = 0;
+            m_arguments.clear();
+            if (!parse_entry(entry)) {
+                return false;
+            }
+            on_entry(entry);
+
+            skip_whitespace();
+            if (consume(']')) {
+                return expect_end();
+            }
+            if (!expect(',')) {
+                return false;
+            }
+            skip_whitespace();
         }
     }
 
-    return std::move(compile_commands);
-}
+    void print_error(const char* path) const
+    {
+        const std::string_view parsed = m_json.substr(0, m_position);
+        const size_t line = std::ranges::count(parsed, '\n') + 1;
+        std::ignore = fprintf(stderr,
+                              "Error parsing compile commands %s at line %zu, "
+                              "byte %zu: %s\n",
+                              path, line, m_position, m_error);
+    }
 
-struct CompileCommandEntrySeparatedArgsSchema
-{
-    std::string directory;
-    std::vector<std::string> arguments;
-    std::string file;
-    std::string output;
+  private:
+    bool parse_entry(CompileCommandEntry& entry)
+    {
+        entry = {};
+        if (!expect('{')) {
+            return false;
+        }
+        skip_whitespace();
+        if (consume('}')) {
+            return true;
+        }
+
+        while (true) {
+            std::string_view key;
+            if (!parse_string(key)) {
+                return false;
+            }
+            skip_whitespace();
+            if (!expect(':')) {
+                return false;
+            }
+            skip_whitespace();
+
+            bool succeeded = true;
+            if (key == "directory") {
+                succeeded = parse_string(entry.directory);
+            } else if (key == "command") {
+                succeeded = parse_string(entry.command);
+            } else if (key == "file") {
+                succeeded = parse_string(entry.file);
+            } else if (key == "output") {
+                succeeded = parse_string(entry.output);
+            } else if (key == "arguments") {
+                succeeded = parse_arguments();
+                entry.arguments = m_arguments;
+            } else {
+                succeeded = skip_value();
+            }
+            if (!succeeded) {
+                return false;
+            }
+
+            skip_whitespace();
+            if (consume('}')) {
+                return true;
+            }
+            if (!expect(',')) {
+                return false;
+            }
+            skip_whitespace();
+        }
+    }
+
+    bool parse_arguments()
+    {
+        if (!expect('[')) {
+            return false;
+        }
+        skip_whitespace();
+        if (consume(']')) {
+            return true;
+        }
+        while (true) {
+            if (!parse_string(m_arguments.emplace_back())) {
+                return false;
+            }
+            skip_whitespace();
+            if (consume(']')) {
+                return true;
+            }
+            if (!expect(',')) {
+                return false;
+            }
+            skip_whitespace();
+        }
+    }
+
+    /// Points into the file unless the string has escapes, in which case it
+    /// is unescaped into storage which is reused for the next entry
+    bool parse_string(std::string_view& out)
+    {
+        if (!expect('"')) {
+            return false;
+        }
+
+        const size_t begin = m_position;
+        bool has_escapes = false;
+        while (m_position < m_json.size() && m_json[m_position] != '"') {
+            if (m_json[m_position] == '\\') {
+                has_escapes = true;
+                ++m_position;
+            }
+            ++m_position;
+        }
+        if (m_position >= m_json.size()) {
+            return fail("unterminated string");
+        }
+
+        const std::string_view raw = m_json.substr(begin, m_position - begin);
+        ++m_position;
+
+        if (!has_escapes) {
+            out = raw;
+            return true;
+        }
+
+        if (m_num_unescaped == m_unescaped.size()) {
+            m_unescaped.emplace_back();
+        }
+        std::string& unescaped = m_unescaped[m_num_unescaped++];
+        unescaped.clear();
+        if (!unescape(raw, unescaped)) {
+            return false;
+        }
+        out = unescaped;
+        return true;
+    }
+
+    bool unescape(std::string_view raw, std::string& out)
+    {
+        for (size_t i = 0; i < raw.size(); ++i) {
+            if (raw[i] != '\\') {
+                out.push_back(raw[i]);
+                continue;
+            }
+            switch (raw[++i]) {
+            case '"':
+            case '\\':
+            case '/':
+                out.push_back(raw[i]);
+                break;
+            case 'b':
+                out.push_back('\b');
+                break;
+            case 'f':
+                out.push_back('\f');
+                break;
+            case 'n':
+                out.push_back('\n');
+                break;
+            case 'r':
+                out.push_back('\r');
+                break;
+            case 't':
+                out.push_back('\t');
+                break;
+            case 'u': {
+                uint32_t code_point = 0;
+                if (!parse_hex4(raw, i + 1, code_point)) {
+                    return false;
+                }
+                i += 4;
+                if (code_point >= 0xDC00 && code_point < 0xE000) {
+                    return fail("unpaired surrogate in \\u escape");
+                }
+                // surrogate pair, which has no utf-8 encoding unless both
+                // halves are there
+                if (code_point >= 0xD800 && code_point < 0xDC00) {
+                    uint32_t low = 0;
+                    if (!raw.substr(i + 1).starts_with("\\u")) {
+                        return fail("unpaired surrogate in \\u escape");
+                    }
+                    if (!parse_hex4(raw, i + 3, low)) {
+                        return false;
+                    }
+                    if (low < 0xDC00 || low >= 0xE000) {
+                        return fail("unpaired surrogate in \\u escape");
+                    }
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+                                 (low - 0xDC00);
+                    i += 6;
+                }
+                append_utf8(code_point, out);
+                break;
+            }
+            default:
+                return fail("invalid escape sequence");
+            }
+        }
+        return true;
+    }
+
+    bool parse_hex4(std::string_view raw, size_t begin, uint32_t& out)
+    {
+        if (begin + 4 > raw.size()) {
+            return fail("truncated \\u escape");
+        }
+        for (const char digit : raw.substr(begin, 4)) {
+            out <<= 4;
+            if (digit >= '0' && digit <= '9') {
+                out |= digit - '0';
+            } else if (digit >= 'a' && digit <= 'f') {
+                out |= digit - 'a' + 10;
+            } else if (digit >= 'A' && digit <= 'F') {
+                out |= digit - 'A' + 10;
+            } else {
+                return fail("invalid \\u escape");
+            }
+        }
+        return true;
+    }
+
+    static void append_utf8(uint32_t code_point, std::string& out)
+    {
+        if (code_point < 0x80) {
+            out.push_back(static_cast<char>(code_point));
+        } else if (code_point < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        } else if (code_point < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+            out.push_back(
+                static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        }
+    }
+
+    /// Skip over a value we don't care about, of any type
+    bool skip_value()
+    {
+        if (m_position >= m_json.size()) {
+            return fail("expected a value");
+        }
+
+        switch (m_json[m_position]) {
+        case '"': {
+            std::string_view ignored;
+            return parse_string(ignored);
+        }
+        case '[':
+        case '{': {
+            const char close = m_json[m_position] == '[' ? ']' : '}';
+            ++m_position;
+            skip_whitespace();
+            if (consume(close)) {
+                return true;
+            }
+            while (true) {
+                if (close == '}') {
+                    std::string_view ignored;
+                    if (!parse_string(ignored)) {
+                        return false;
+                    }
+                    skip_whitespace();
+                    if (!expect(':')) {
+                        return false;
+                    }
+                    skip_whitespace();
+                }
+                if (!skip_value()) {
+                    return false;
+                }
+                skip_whitespace();
+                if (consume(close)) {
+                    return true;
+                }
+                if (!expect(',')) {
+                    return false;
+                }
+                skip_whitespace();
+            }
+        }
+        default: {
+            // number, true, false or null
+            const size_t end = m_json.find_first_of(",]} \t\r\n", m_position);
+            if (end == m_position) {
+                return fail("expected a value");
+            }
+            m_position = std::min(end, m_json.size());
+            return true;
+        }
+        }
+    }
+
+    void skip_whitespace()
+    {
+        while (m_position < m_json.size() &&
+               (m_json[m_position] == ' ' || m_json[m_position] == '\n' ||
+                m_json[m_position] == '\r' || m_json[m_position] == '\t')) {
+            ++m_position;
+        }
+    }
+
+    bool consume(char character)
+    {
+        if (m_position < m_json.size() && m_json[m_position] == character) {
+            ++m_position;
+            return true;
+        }
+        return false;
+    }
+
+    bool expect(char character)
+    {
+        if (consume(character)) {
+            return true;
+        }
+        switch (character) {
+        case '[':
+            return fail("expected '['");
+        case ']':
+            return fail("expected ']'");
+        case '{':
+            return fail("expected '{'");
+        case ',':
+            return fail("expected ','");
+        case ':':
+            return fail("expected ':'");
+        case '"':
+            return fail("expected a string");
+        default:
+            return fail("unexpected character");
+        }
+    }
+
+    // only whitespace may follow the top level array
+    bool expect_end()
+    {
+        skip_whitespace();
+        if (m_position < m_json.size()) {
+            return fail("unexpected data after the end of the array");
+        }
+        return true;
+    }
+
+    bool fail(const char* error)
+    {
+        m_error = error;
+        return false;
+    }
+
+    std::string_view m_json;
+    size_t m_position = 0;
+    const char* m_error = "";
+    std::vector<std::string_view> m_arguments;
+    // deque so that views of earlier strings in the same entry stay valid,
+    // reused from entry to entry so unescaping rarely allocates
+    std::deque<std::string> m_unescaped;
+    size_t m_num_unescaped = 0;
 };
+} // namespace
 
-std::optional<std::vector<CompileCommandEntry>>
-parse_compile_commands_json_file_separated_args(
-    const std::string_view& file) noexcept
+bool for_each_compile_command(
+    const std::string_view& file,
+    const std::function<void(const CompileCommandEntry&)>& on_entry) noexcept
 {
-    // read entire file into string
-    std::vector<CompileCommandEntrySeparatedArgsSchema> compile_commands;
-    {
-        std::string buffer{};
-        // about a million bytes
-        buffer.reserve(1024UL * 1024UL);
-        auto read_err = glz::read_file_json(compile_commands, file, buffer);
-
-        if (read_err) {
-            std::println(stderr, "Error parsing compile commands: {}",
-                         glz::format_error(read_err, buffer));
-            return {};
-        }
-    }
-
-    std::vector<CompileCommandEntry> actual_output_format;
-    actual_output_format.reserve(compile_commands.size());
-
-    std::transform(compile_commands.begin(), compile_commands.end(),
-                   std::back_inserter(actual_output_format),
-                   [](CompileCommandEntrySeparatedArgsSchema& separated) {
-                       std::string concatenated;
-                       for (auto& arg : separated.arguments) {
-                           concatenated += std::move(arg);
-                           if (&arg != &separated.arguments.back()) {
-                               concatenated += " ";
-                           }
-                       }
-                       return CompileCommandEntry{
-                           .directory = std::move(separated.directory),
-                           .command = std::move(concatenated),
-                           .file = std::move(separated.file),
-                           .output = std::move(separated.output),
-                       };
-                   });
-
-    return std::move(actual_output_format);
+    const std::string path{file};
+    // read front to back exactly once
+    auto mapped = MappedFile::open(path, MADV_SEQUENTIAL);
+    if (!mapped.has_value()) {
+        std::ignore = fprintf(stderr, "Unable to open compile commands %s\n",
+                              path.c_str());
+        return false;
+    }
+
+    CompileCommandsParser parser(mapped->view());
+    if (!parser.parse(on_entry)) {
+        parser.print_error(path.c_str());
+        return false;
+    }
+    return true;
 }
 
 } // namespace cn
@@ -1,26 +1,32 @@
 #ifndef __CODENODES_COMPILE_COMMANDS_ENTRY_H__
 #define __CODENODES_COMPILE_COMMANDS_ENTRY_H__
 
-#include <optional>
-#include <string>
-#include <vector>
+#include <functional>
+#include <span>
+#include <string_view>
 
 namespace cn {
 
+/// One entry of a compile_commands.json. Either command or arguments is given,
+/// see CompileArgsTable for turning either into arguments for clang. Strings
+/// point into the mapped file where possible, and are only valid for the
+/// duration of the callback they were passed to
 struct CompileCommandEntry
 {
-    std::string directory;
-    std::string command;
-    std::string file;
-    std::string output;
+    std::string_view directory;
+    std::string_view command;
+    std::span<const std::string_view> arguments;
+    std::string_view file;
+    std::string_view output;
 };
 
-std::optional<std::vector<CompileCommandEntry>>
-parse_compile_commands_json_file(const std::string_view& file) noexcept;
-
-std::optional<std::vector<CompileCommandEntry>>
-parse_compile_commands_json_file_separated_args(
-    const std::string_view& file) noexcept;
+/// Memory maps a compile_commands.json and calls on_entry for each entry as
+/// soon as it has been parsed, in order. Returns false if the file can't be
+/// read or is not valid JSON, in which case the entries before the error were
+/// still passed to on_entry
+bool for_each_compile_command(
+    const std::string_view& file,
+    const std::function<void(const CompileCommandEntry&)>& on_entry) noexcept;
 
 } // namespace cn
 
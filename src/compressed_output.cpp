@@ -0,0 +1,378 @@
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "compressed_output.h"
+
+namespace cn {
+
+namespace {
+// what the writer fills before handing it over, and how many of those can be
+// waiting on the compressor before the writer has to wait too
+constexpr size_t chunk_size = size_t{1} << 20;
+constexpr size_t max_chunks_in_flight = 4;
+
+class Compressor
+{
+  public:
+    Compressor() = default;
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+    Compressor(Compressor&&) = delete;
+    Compressor& operator=(Compressor&&) = delete;
+    virtual ~Compressor() = default;
+
+    /// Appends input to out compressed, and ends the stream if last. Prints
+    /// why and returns false if it failed
+    virtual bool compress(std::string_view input, bool last,
+                          std::string& out) = 0;
+};
+
+class CopyCompressor final : public Compressor
+{
+  public:
+    bool compress(std::string_view input, bool /*last*/,
+                  std::string& out) override
+    {
+        out.append(input);
+        return true;
+    }
+};
+
+class ZstdCompressor final : public Compressor
+{
+  public:
+    explicit ZstdCompressor(std::optional<int> level)
+        : m_context(ZSTD_createCCtx())
+    {
+        if (m_context != nullptr && level.has_value()) {
+            std::ignore = ZSTD_CCtx_setParameter(
+                m_context, ZSTD_c_compressionLevel, level.value());
+        }
+    }
+
+    ZstdCompressor(const ZstdCompressor&) = delete;
+    ZstdCompressor& operator=(const ZstdCompressor&) = delete;
+    ZstdCompressor(ZstdCompressor&&) = delete;
+    ZstdCompressor& operator=(ZstdCompressor&&) = delete;
+    ~ZstdCompressor() override { ZSTD_freeCCtx(m_context); }
+
+    bool compress(std::string_view input, bool last, std::string& out) override
+    {
+        if (m_context == nullptr) {
+            std::ignore = fprintf(stderr, "Unable to start zstd\n");
+            return false;
+        }
+
+        ZSTD_inBuffer in{.src = input.data(), .size = input.size(), .pos = 0};
+        const ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+        while (true) {
+            const size_t start = out.size();
+            out.resize(start + ZSTD_CStreamOutSize());
+            ZSTD_outBuffer compressed{
+                .dst = out.data() + start,
+                .size = out.size() - start,
+                .pos = 0,
+            };
+            const size_t left =
+                ZSTD_compressStream2(m_context, &compressed, &in, mode);
+            out.resize(start + compressed.pos);
+            if (ZSTD_isError(left) != 0) {
+                std::ignore = fprintf(stderr, "zstd failed: %s\n",
+                                      ZSTD_getErrorName(left));
+                return false;
+            }
+            // ending only finishes once everything is flushed, otherwise
+            // zstd may hold on to input until it has a whole block
+            if (last ? left == 0 : in.pos == in.size) {
+                return true;
+            }
+        }
+    }
+
+  private:
+    ZSTD_CCtx* m_context;
+};
+
+class GzipCompressor final : public Compressor
+{
+  public:
+    explicit GzipCompressor(std::optional<int> level)
+    {
+        // 16 on top of the largest window asks for a gzip header and trailer
+        m_started = deflateInit2(&m_stream,
+                                 level.value_or(Z_DEFAULT_COMPRESSION),
+                                 Z_DEFLATED, MAX_WBITS + 16, 8,
+                                 Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    GzipCompressor(const GzipCompressor&) = delete;
+    GzipCompressor& operator=(const GzipCompressor&) = delete;
+    GzipCompressor(GzipCompressor&&) = delete;
+    GzipCompressor& operator=(GzipCompressor&&) = delete;
+
+    ~GzipCompressor() override
+    {
+        if (m_started) {
+            deflateEnd(&m_stream);
+        }
+    }
+
+    bool compress(std::string_view input, bool last, std::string& out) override
+    {
+        if (!m_started) {
+            std::ignore = fprintf(stderr, "Unable to start gzip\n");
+            return false;
+        }
+
+        // zlib never writes through next_in
+        m_stream.next_in =
+            reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        m_stream.avail_in = static_cast<uInt>(input.size());
+        while (true) {
+            const size_t start = out.size();
+            out.resize(start + chunk_size);
+            m_stream.next_out = reinterpret_cast<Bytef*>(out.data() + start);
+            m_stream.avail_out = static_cast<uInt>(chunk_size);
+            const int result = deflate(&m_stream, last ? Z_FINISH : Z_NO_FLUSH);
+            out.resize(start + chunk_size - m_stream.avail_out);
+            if (result == Z_STREAM_ERROR) {
+                std::ignore = fprintf(stderr, "gzip failed\n");
+                return false;
+            }
+            // output space left over means nothing more is pending
+            if (last ? result == Z_STREAM_END
+                     : m_stream.avail_in == 0 && m_stream.avail_out != 0) {
+                return true;
+            }
+        }
+    }
+
+  private:
+    z_stream m_stream{};
+    bool m_started = false;
+};
+
+std::unique_ptr<Compressor> make_compressor(Compression compression,
+                                            std::optional<int> level)
+{
+    switch (compression) {
+    case Compression::None:
+        break;
+    case Compression::Zstd:
+        return std::make_unique<ZstdCompressor>(level);
+    case Compression::Gzip:
+        return std::make_unique<GzipCompressor>(level);
+    }
+    return std::make_unique<CopyCompressor>();
+}
+} // namespace
+
+/// Fills one chunk at a time for the compressing thread, which takes them in
+/// order and writes what comes out to the real output
+class CompressingStream::Buffer final : public std::streambuf
+{
+  public:
+    Buffer(std::ostream& output, std::unique_ptr<Compressor> compressor)
+        : m_output(output), m_compressor(std::move(compressor))
+    {
+        m_current = std::make_unique_for_overwrite<char[]>(chunk_size);
+        setp(m_current.get(), m_current.get() + chunk_size);
+        m_thread = std::jthread([this] { work(); });
+    }
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+    Buffer(Buffer&&) = delete;
+    Buffer& operator=(Buffer&&) = delete;
+
+    ~Buffer() override { std::ignore = close(); }
+
+    bool close()
+    {
+        if (!m_thread.joinable()) {
+            return !m_failed;
+        }
+        std::ignore = submit();
+        {
+            std::lock_guard lock(m_mutex);
+            m_closing = true;
+        }
+        m_condition.notify_all();
+        m_thread.join();
+        setp(nullptr, nullptr);
+        return !m_failed;
+    }
+
+  protected:
+    int_type overflow(int_type character) override
+    {
+        if (!submit()) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(character, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(character);
+            pbump(1);
+        }
+        return traits_type::not_eof(character);
+    }
+
+    int sync() override { return submit() ? 0 : -1; }
+
+  private:
+    struct Chunk
+    {
+        std::unique_ptr<char[]> bytes;
+        size_t size;
+    };
+
+    /// Hands over whatever was written to the current chunk and starts
+    /// another, waiting if the compressor is too far behind. False once it
+    /// failed
+    bool submit()
+    {
+        const auto size = static_cast<size_t>(pptr() - pbase());
+        std::unique_lock lock(m_mutex);
+        if (size != 0) {
+            m_condition.wait(lock, [this] {
+                return m_failed || m_queue.size() < max_chunks_in_flight;
+            });
+            if (!m_failed) {
+                m_queue.push_back(
+                    {.bytes = std::move(m_current), .size = size});
+                if (m_free.empty()) {
+                    m_current =
+                        std::make_unique_for_overwrite<char[]>(chunk_size);
+                } else {
+                    m_current = std::move(m_free.back());
+                    m_free.pop_back();
+                }
+                m_condition.notify_all();
+            }
+        }
+        setp(m_current.get(), m_current.get() + chunk_size);
+        return !m_failed;
+    }
+
+    void work()
+    {
+        std::string compressed;
+        while (true) {
+            Chunk chunk{};
+            {
+                std::unique_lock lock(m_mutex);
+                m_condition.wait(
+                    lock, [this] { return !m_queue.empty() || m_closing; });
+                if (!m_queue.empty()) {
+                    chunk = std::move(m_queue.front());
+                    m_queue.pop_front();
+                }
+            }
+
+            // the queue is only empty here once closing, and nothing else
+            // can come after it
+            const bool last = chunk.bytes == nullptr;
+            compressed.clear();
+            const bool written =
+                m_compressor->compress({chunk.bytes.get(), chunk.size}, last,
+                                       compressed) &&
+                m_output.write(compressed.data(),
+                               static_cast<std::streamsize>(compressed.size()))
+                    .good();
+            if (!written && m_output.fail()) {
+                std::ignore =
+                    fprintf(stderr, "Unable to write compressed output\n");
+            }
+
+            {
+                std::lock_guard lock(m_mutex);
+                m_failed = !written;
+                if (!last) {
+                    m_free.push_back(std::move(chunk.bytes));
+                }
+            }
+            m_condition.notify_all();
+            if (last || !written) {
+                return;
+            }
+        }
+    }
+
+    std::ostream& m_output;
+    std::unique_ptr<Compressor> m_compressor;
+    // the chunk being written into, which the put area points at
+    std::unique_ptr<char[]> m_current;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<Chunk> m_queue;
+    // compressed chunks, to be reused
+    std::vector<std::unique_ptr<char[]>> m_free;
+    bool m_closing = false;
+    bool m_failed = false;
+    // last, so that it is joined before anything above is destroyed
+    std::jthread m_thread;
+};
+
+std::optional<Compression>
+compression_from_name(std::string_view name) noexcept
+{
+    if (name == "none") {
+        return Compression::None;
+    }
+    if (name == "zstd") {
+        return Compression::Zstd;
+    }
+    if (name == "gzip") {
+        return Compression::Gzip;
+    }
+    return {};
+}
+
+bool is_valid_compression_level(Compression compression, int level) noexcept
+{
+    switch (compression) {
+    case Compression::None:
+        return true;
+    case Compression::Zstd:
+        return level >= ZSTD_minCLevel() && level <= ZSTD_maxCLevel();
+    case Compression::Gzip:
+        return level >= Z_NO_COMPRESSION && level <= Z_BEST_COMPRESSION;
+    }
+    return false;
+}
+
+CompressingStream::CompressingStream(std::ostream& output,
+                                     Compression compression,
+                                     std::optional<int> level)
+    : std::ostream(nullptr),
+      m_buffer(std::make_unique<Buffer>(output,
+                                        make_compressor(compression, level)))
+{
+    rdbuf(m_buffer.get());
+}
+
+CompressingStream::~CompressingStream() { std::ignore = close(); }
+
+bool CompressingStream::close() noexcept
+{
+    const bool closed = m_buffer->close();
+    if (!closed) {
+        setstate(std::ios::badbit);
+    }
+    return closed;
+}
+
+} // namespace cn
@@ -0,0 +1,61 @@
+#ifndef __CODENODES_COMPRESSED_OUTPUT_H__
+#define __CODENODES_COMPRESSED_OUTPUT_H__
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string_view>
+
+namespace cn {
+
+enum class Compression : uint8_t
+{
+    None,
+    Zstd,
+    Gzip,
+};
+
+/// none, zstd or gzip
+[[nodiscard]] std::optional<Compression>
+compression_from_name(std::string_view name) noexcept;
+
+/// Whether the compressor accepts this level, 1 to 9 for gzip and 1 to 22 for
+/// zstd, and a few more on either end
+[[nodiscard]] bool is_valid_compression_level(Compression compression,
+                                              int level) noexcept;
+
+/// A stream which compresses everything written to it before passing it on to
+/// another. Compression runs on a thread of its own, a few buffers behind
+/// whoever is writing, so formatting and compressing overlap. The output is
+/// one complete zstd frame or gzip member once close() returns
+class CompressingStream : public std::ostream
+{
+  public:
+    /// level is the compressor's own scale, nothing picks its default. output
+    /// should be opened in binary mode and must outlive this
+    CompressingStream(std::ostream& output, Compression compression,
+                      std::optional<int> level = {});
+
+    CompressingStream(const CompressingStream&) = delete;
+    CompressingStream& operator=(const CompressingStream&) = delete;
+    CompressingStream(CompressingStream&&) = delete;
+    CompressingStream& operator=(CompressingStream&&) = delete;
+
+    /// Closes the stream if that wasn't done already
+    ~CompressingStream() override;
+
+    /// Compresses what is left and ends the frame. Nothing may be written
+    /// afterwards. False, after printing why, if compressing or writing
+    /// anything failed
+    [[nodiscard]] bool close() noexcept;
+
+    class Buffer;
+
+  private:
+    std::unique_ptr<Buffer> m_buffer;
+};
+
+} // namespace cn
+
+#endif
@@ -0,0 +1,579 @@
+#include <algorithm>
+#include <cinttypes>
+#include <filesystem>
+#include <fstream>
+#include <glaze/glaze.hpp>
+#include <ranges>
+
+#include "clang_to_graphml_impl.h"
+#include "fragment_cache.h"
+
+static_assert(glz::reflectable<cn::Fragment>);
+
+namespace cn {
+
+namespace {
+constexpr uint64_t fnv_offset_basis = 0xcbf29ce484222325ULL;
+constexpr uint64_t fnv_prime = 0x100000001b3ULL;
+
+constexpr uint64_t fnv1a(std::string_view bytes,
+                         uint64_t hash = fnv_offset_basis)
+{
+    for (const char byte : bytes) {
+        hash ^= static_cast<uint8_t>(byte);
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+/// Any failure, including not being able to tell the size, is a cache miss
+std::optional<std::string> read_whole_file(const std::string& path)
+{
+    std::error_code error;
+    const uintmax_t size = std::filesystem::file_size(path, error);
+    if (error) {
+        return {};
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return {};
+    }
+    std::string contents;
+    contents.resize(static_cast<size_t>(size));
+    file.read(contents.data(), static_cast<std::streamsize>(contents.size()));
+    // a file that grew since we asked for its size is not read whole either
+    if (!file || file.peek() != std::ifstream::traits_type::eof()) {
+        return {};
+    }
+    return contents;
+}
+
+/// Every index refers to a symbol in the fragment, and parents come before
+/// their children
+bool is_well_formed(const Fragment& fragment)
+{
+    const size_t num_symbols = fragment.symbols.size();
+    const auto in_range = [num_symbols](const std::vector<uint32_t>& indices) {
+        return std::ranges::all_of(
+            indices, [num_symbols](uint32_t index) {
+                return index < num_symbols;
+            });
+    };
+
+    for (size_t i = 0; i < num_symbols; ++i) {
+        const FragmentSymbol& symbol = fragment.symbols[i];
+        if (symbol.parent >= static_cast<int64_t>(i) ||
+            !in_range(symbol.type_refs) || !in_range(symbol.parent_classes) ||
+            !in_range(symbol.field_types) || !in_range(symbol.inner_classes) ||
+            !in_range(symbol.member_functions) ||
+            !in_range(symbol.inner_enums) ||
+            !in_range(symbol.parameter_types) ||
+            !in_range(symbol.return_type) || !in_range(symbol.callees) ||
+            symbol.callees.size() != symbol.call_counts.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Each reference from a fragment is restored as a plain user defined type
+const TypeIdentifier* type_referencing(TypeTable& types, Symbol* symbol)
+{
+    return types.intern(TypeIdentifier{NonReferenceTypeIdentifier{
+        ConcreteTypeIdentifier{UserDefinedTypeIdentifier{symbol}}}});
+}
+
+/// Only a function pointer return type refers to more than one symbol
+const TypeIdentifier*
+return_type_referencing(TypeTable& types, const std::vector<uint32_t>& indices,
+                        std::span<Symbol* const> symbols)
+{
+    switch (indices.size()) {
+    case 0:
+        return types.intern(TypeIdentifier{NonReferenceTypeIdentifier{
+            ConcreteTypeIdentifier{PrimitiveTypeType::Void}}});
+    case 1:
+        return type_referencing(types, symbols[indices.front()]);
+    default: {
+        std::vector<const TypeIdentifier*> referenced;
+        referenced.reserve(indices.size());
+        for (const uint32_t index : indices) {
+            referenced.push_back(type_referencing(types, symbols[index]));
+        }
+        return types.intern(TypeIdentifier{
+            NonReferenceTypeIdentifier{PointerTypeIdentifier{
+                FunctionProtoTypeIdentifier{types.intern(referenced)}}}});
+    }
+    }
+}
+} // namespace
+
+FragmentCache::FragmentCache(std::string directory) noexcept
+    : m_directory(std::move(directory))
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    if (error) {
+        std::ignore = fprintf(stderr,
+                              "Unable to create fragment cache directory "
+                              "%s: %s\n",
+                              m_directory.c_str(), error.message().c_str());
+    }
+}
+
+std::optional<uint64_t>
+FragmentCache::key_for(const char* filename,
+                       std::span<const char* const> command_args,
+                       const BuilderOptions& options) noexcept
+{
+    const auto main_file_hash = hash_file(filename);
+    if (!main_file_hash.has_value()) {
+        return {};
+    }
+
+    const std::array<uint64_t, 6> header{
+        version,
+        static_cast<uint64_t>(options.engine),
+        static_cast<uint64_t>(options.depth),
+        main_file_hash.value(),
+        static_cast<uint64_t>(options.no_system_headers),
+        // one past the depth, so that 0 means no limit
+        options.max_include_depth.transform([](unsigned depth) {
+            return uint64_t{depth} + 1;
+        }).value_or(0),
+    };
+    uint64_t key = fnv1a(std::string_view{
+        reinterpret_cast<const char*>(header.data()), sizeof(header)});
+
+    // keep the null terminators so that {"ab", "c"} and {"a", "bc"} differ.
+    // the file is not among the args, and two files could have the same
+    // contents and flags
+    key = fnv1a(std::string_view{filename, strlen(filename) + 1}, key);
+    for (const char* arg : command_args) {
+        key = fnv1a(std::string_view{arg, strlen(arg) + 1}, key);
+    }
+    // the separators keep an include glob from hashing like an exclude glob
+    for (const std::string& glob : options.include_paths) {
+        key = fnv1a(std::string_view{glob.c_str(), glob.size() + 1}, key);
+    }
+    key = fnv1a(std::string_view{"\1", 1}, key);
+    for (const std::string& glob : options.exclude_paths) {
+        key = fnv1a(std::string_view{glob.c_str(), glob.size() + 1}, key);
+    }
+
+    // headers which come from a PCH are not reported as inclusions, so they
+    // would never be checked as dependencies. the PCH's path does not change
+    // when they do, but its contents do
+    for (size_t i = 1; i < command_args.size(); ++i) {
+        if (strcmp(command_args[i - 1], "-include-pch") != 0) {
+            continue;
+        }
+        const auto pch_hash = hash_file(command_args[i]);
+        if (!pch_hash.has_value()) {
+            return {};
+        }
+        key = fnv1a(std::string_view{reinterpret_cast<const char*>(
+                                         &pch_hash.value()),
+                                     sizeof(uint64_t)},
+                    key);
+    }
+    return key;
+}
+
+std::optional<Fragment> FragmentCache::load(uint64_t key,
+                                            const char* filename) noexcept
+{
+    const std::string path = path_for(key);
+    if (!std::filesystem::exists(path)) {
+        return {};
+    }
+
+    auto buffer = read_whole_file(path);
+    if (!buffer.has_value()) {
+        return {};
+    }
+
+    Fragment fragment{};
+    if (auto error = glz::read_beve(fragment, buffer.value())) {
+        std::ignore = fprintf(stderr,
+                              "Ignoring unreadable fragment %s for %s: %s\n",
+                              path.c_str(), filename,
+                              glz::format_error(error, buffer.value()).c_str());
+        return {};
+    }
+
+    // a different version would have had a different key, so this is just a
+    // hash collision
+    if (fragment.version != version || fragment.main_file != filename) {
+        return {};
+    }
+
+    if (!is_well_formed(fragment)) {
+        std::ignore =
+            fprintf(stderr, "Ignoring corrupt fragment %s for %s\n",
+                    path.c_str(), filename);
+        return {};
+    }
+
+    for (const auto& dependency : fragment.dependencies) {
+        if (hash_file(dependency.path) != dependency.content_hash) {
+            return {};
+        }
+    }
+
+    return fragment;
+}
+
+void FragmentCache::save(uint64_t key, const Fragment& fragment) noexcept
+{
+    std::string buffer;
+    if (auto error = glz::write_beve(fragment, buffer)) {
+        std::ignore =
+            fprintf(stderr, "Unable to serialize fragment for %s\n",
+                    fragment.main_file.c_str());
+        return;
+    }
+
+    // write then rename, so that a run which is killed halfway or another
+    // run sharing the directory never sees half a fragment
+    const std::string path = path_for(key);
+    const std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (!file) {
+            std::ignore = fprintf(stderr, "Unable to write fragment %s\n",
+                                  temporary_path.c_str());
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    if (error) {
+        std::ignore = fprintf(stderr, "Unable to write fragment %s: %s\n",
+                              path.c_str(), error.message().c_str());
+    }
+}
+
+std::optional<uint64_t>
+FragmentCache::hash_file(const std::string& path) noexcept
+{
+    {
+        std::lock_guard lock(m_mutex);
+        if (auto iter = m_file_hashes.find(path); iter != m_file_hashes.end()) {
+            return iter->second;
+        }
+    }
+
+    // read outside the lock, at worst two jobs hash the same header at once
+    std::optional<uint64_t> hash =
+        read_whole_file(path).transform([](const std::string& contents) {
+            return fnv1a(contents);
+        });
+
+    std::lock_guard lock(m_mutex);
+    m_file_hashes.try_emplace(path, hash);
+    return hash;
+}
+
+std::string FragmentCache::path_for(uint64_t key) const
+{
+    std::array<char, 32> name{};
+    std::ignore =
+        snprintf(name.data(), name.size(), "%016" PRIx64 ".beve", key);
+    return (std::filesystem::path(m_directory) / name.data()).string();
+}
+
+bool ClangToGraphMLBuilder::Job::load_fragment() noexcept
+{
+    auto fragment = shared_data->fragment_cache->load(cache_key.value(),
+                                                      main_file.c_str());
+    if (!fragment.has_value()) {
+        return false;
+    }
+
+    auto& allocator = shared_data->allocator;
+    std::vector<Symbol*> symbols;
+    symbols.reserve(fragment->symbols.size());
+
+    for (const FragmentSymbol& stored : fragment->symbols) {
+        Symbol* parent =
+            stored.parent < 0 ? nullptr : symbols.at(stored.parent);
+        const UsrId usr = shared_data->usrs.intern(stored.usr);
+
+        Symbol* symbol = shared_data->symbols_by_usr.find(usr);
+        if (symbol == nullptr) {
+            String name{stored.name, allocator};
+            switch (static_cast<SymbolKind>(stored.kind)) {
+            case SymbolKind::Namespace:
+                symbol = allocator.new_object<NamespaceSymbol>(
+                    allocator, parent, usr, std::nullopt,
+                    std::move(name));
+                break;
+            case SymbolKind::Function:
+                symbol = allocator.new_object<FunctionSymbol>(
+                    allocator, parent, usr, std::nullopt,
+                    std::move(name));
+                break;
+            case SymbolKind::Enum:
+                symbol = allocator.new_object<EnumTypeSymbol>(
+                    allocator, parent, usr, std::nullopt,
+                    std::move(name));
+                break;
+            case SymbolKind::Aggregate:
+                symbol = allocator.new_object<ClassSymbol>(
+                    allocator, parent, usr,
+                    static_cast<ClassSymbol::AggregateKind>(
+                        stored.aggregate_kind),
+                    std::move(name));
+                break;
+            default:
+                std::ignore = fprintf(
+                    stderr, "Fragment for %s has a symbol of unknown kind %d\n",
+                    main_file.c_str(), stored.kind);
+                return false;
+            }
+            symbol = shared_data->symbols_by_usr.insert_or_get(usr, symbol);
+        }
+
+        // USRs encode the kind, so this means the fragment is corrupt. the
+        // symbols inserted so far are harmless, parsing fills them in
+        if (static_cast<uint8_t>(symbol->symbol_kind) != stored.kind) {
+            std::ignore = fprintf(stderr,
+                                  "Fragment for %s disagrees about the kind "
+                                  "of %s, parsing instead\n",
+                                  main_file.c_str(), stored.usr.c_str());
+            return false;
+        }
+        symbols.push_back(symbol);
+    }
+
+    const auto restore_types = [&](const std::vector<uint32_t>& indices,
+                                   OrderedCollection<const TypeIdentifier*>&
+                                       out) {
+        out.reserve(indices.size());
+        for (const uint32_t index : indices) {
+            out.emplace_back(
+                type_referencing(shared_data->types, symbols.at(index)));
+        }
+    };
+
+    const auto restore_symbols = [&]<typename T>(
+                                     const std::vector<uint32_t>& indices,
+                                     OrderedCollection<T*>& out) {
+        out.reserve(indices.size());
+        for (const uint32_t index : indices) {
+            if (T* symbol = symbols.at(index)->upcast<T>()) {
+                out.emplace_back(symbol);
+            }
+        }
+    };
+
+    const auto restore_calls = [&](const FragmentSymbol& stored,
+                                   FunctionSymbol& function) {
+        std::vector<FunctionSymbol::Call> calls;
+        calls.reserve(stored.callees.size());
+        for (size_t i = 0; i < stored.callees.size(); ++i) {
+            if (auto* callee =
+                    symbols.at(stored.callees[i])->upcast<FunctionSymbol>()) {
+                calls.push_back({.callee = callee,
+                                 .count = stored.call_counts[i]});
+            }
+        }
+        if (calls.empty()) {
+            return;
+        }
+        auto* out = allocator.allocate_object<FunctionSymbol::Call>(
+            calls.size());
+        std::ranges::copy(calls, out);
+        function.calls = {out, calls.size()};
+    };
+
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        const FragmentSymbol& stored = fragment->symbols[i];
+        Symbol* symbol = symbols[i];
+
+        // claimed apart from the rest of the symbol, same as when parsing
+        if (auto* function = symbol->upcast<FunctionSymbol>();
+            function != nullptr && stored.has_calls &&
+            !function->calls_claimed.exchange(true,
+                                              std::memory_order_acq_rel)) {
+            restore_calls(stored, *function);
+        }
+
+        if (stored.in_scope) {
+            symbol->in_scope.store(true, std::memory_order_relaxed);
+        }
+
+        // first to claim a symbol fills it in, same as when parsing
+        if (!stored.filled ||
+            symbol->visited.exchange(true, std::memory_order_acq_rel)) {
+            continue;
+        }
+
+        if (auto* klass = symbol->upcast<ClassSymbol>()) {
+            restore_types(stored.type_refs, klass->type_refs);
+            restore_types(stored.parent_classes, klass->parent_classes);
+            restore_types(stored.field_types, klass->field_types);
+            restore_symbols(stored.inner_classes, klass->inner_classes);
+            restore_symbols(stored.member_functions, klass->member_functions);
+            restore_symbols(stored.inner_enums, klass->inner_enums);
+        } else if (auto* function = symbol->upcast<FunctionSymbol>()) {
+            restore_types(stored.parameter_types, function->parameter_types);
+            if (stored.has_return_type) {
+                function->return_type = return_type_referencing(
+                    shared_data->types, stored.return_type, symbols);
+            }
+        }
+    }
+
+    return true;
+}
+
+void ClangToGraphMLBuilder::Job::save_fragment() noexcept
+{
+    Fragment fragment{
+        .version = FragmentCache::version,
+        .main_file = main_file,
+        .dependencies = std::move(dependencies),
+        .symbols = {},
+    };
+
+    std::unordered_map<Symbol*, uint32_t> index_by_symbol;
+    std::vector<Symbol*> unstored_parents;
+
+    // parents go before children, so that loading can resolve them in one
+    // pass
+    const auto index_of = [&](Symbol* symbol) -> uint32_t {
+        if (auto iter = index_by_symbol.find(symbol);
+            iter != index_by_symbol.end()) {
+            return iter->second;
+        }
+
+        unstored_parents.clear();
+        int64_t parent = -1;
+        for (Symbol* iter = symbol->semantic_parent; iter != nullptr;
+             iter = iter->semantic_parent) {
+            if (auto found = index_by_symbol.find(iter);
+                found != index_by_symbol.end()) {
+                parent = found->second;
+                break;
+            }
+            unstored_parents.push_back(iter);
+        }
+        unstored_parents.insert(unstored_parents.begin(), symbol);
+
+        // outermost first
+        for (Symbol* unstored : unstored_parents | std::views::reverse) {
+            const auto* klass = unstored->upcast<ClassSymbol>();
+            const auto index = static_cast<uint32_t>(fragment.symbols.size());
+            fragment.symbols.push_back(FragmentSymbol{
+                .usr = std::string{shared_data->usrs.view(unstored->usr)},
+                .name = std::string{unstored->name},
+                .kind = static_cast<uint8_t>(unstored->symbol_kind),
+                .aggregate_kind = static_cast<uint8_t>(
+                    klass ? klass->aggregate_kind
+                          : ClassSymbol::AggregateKind::Class),
+                .parent = parent,
+            });
+            index_by_symbol.emplace(unstored, index);
+            parent = index;
+        }
+        return static_cast<uint32_t>(parent);
+    };
+
+    // these may add symbols, so they return rather than writing into
+    // fragment.symbols directly
+    const auto store_types =
+        [&](const OrderedCollection<const TypeIdentifier*>& types) {
+            std::vector<uint32_t> out;
+            for (size_t i = 0; i < types.size(); ++i) {
+                const TypeIdentifier* type = types.at(i);
+                for (size_t j = 0; j < type->get_num_symbols(); ++j) {
+                    if (Symbol* target = type->try_get_symbol(j)) {
+                        out.push_back(index_of(target));
+                    }
+                }
+            }
+            return out;
+        };
+
+    const auto store_symbols =
+        [&]<typename T>(const OrderedCollection<T*>& targets) {
+            std::vector<uint32_t> out;
+            out.reserve(targets.size());
+            for (size_t i = 0; i < targets.size(); ++i) {
+                out.push_back(index_of(targets.at(i)));
+            }
+            return out;
+        };
+
+    for (const auto& [symbol, has_definition] : touched_symbols) {
+        const uint32_t index = index_of(symbol);
+        fragment.symbols[index].in_scope = true;
+
+        // only what was defined in this translation unit, otherwise its
+        // contents could go stale without any of our dependencies changing
+        if (!has_definition || !symbol->visited.load()) {
+            continue;
+        }
+
+        if (auto* klass = symbol->upcast<ClassSymbol>()) {
+            auto type_refs = store_types(klass->type_refs);
+            auto parent_classes = store_types(klass->parent_classes);
+            auto field_types = store_types(klass->field_types);
+            auto inner_classes = store_symbols(klass->inner_classes);
+            auto member_functions = store_symbols(klass->member_functions);
+            auto inner_enums = store_symbols(klass->inner_enums);
+
+            FragmentSymbol& stored = fragment.symbols[index];
+            stored.filled = true;
+            stored.type_refs = std::move(type_refs);
+            stored.parent_classes = std::move(parent_classes);
+            stored.field_types = std::move(field_types);
+            stored.inner_classes = std::move(inner_classes);
+            stored.member_functions = std::move(member_functions);
+            stored.inner_enums = std::move(inner_enums);
+        } else if (auto* function = symbol->upcast<FunctionSymbol>()) {
+            auto parameter_types = store_types(function->parameter_types);
+            std::vector<uint32_t> return_type;
+            if (const TypeIdentifier* type = function->return_type) {
+                for (size_t j = 0; j < type->get_num_symbols(); ++j) {
+                    if (Symbol* target = type->try_get_symbol(j)) {
+                        return_type.push_back(index_of(target));
+                    }
+                }
+            }
+
+            FragmentSymbol& stored = fragment.symbols[index];
+            stored.filled = true;
+            stored.parameter_types = std::move(parameter_types);
+            stored.has_return_type = function->return_type != nullptr;
+            stored.return_type = std::move(return_type);
+        }
+    }
+
+    // calls are stored wherever the body was, even if another job recorded
+    // them, for the same reason as above
+    for (FunctionSymbol* function : defined_functions) {
+        const uint32_t index = index_of(function);
+        std::vector<uint32_t> callees;
+        std::vector<uint32_t> call_counts;
+        callees.reserve(function->calls.size());
+        call_counts.reserve(function->calls.size());
+        for (const FunctionSymbol::Call& call : function->calls) {
+            callees.push_back(index_of(call.callee));
+            call_counts.push_back(call.count);
+        }
+
+        FragmentSymbol& stored = fragment.symbols[index];
+        stored.has_calls = true;
+        stored.callees = std::move(callees);
+        stored.call_counts = std::move(call_counts);
+    }
+
+    shared_data->fragment_cache->save(cache_key.value(), fragment);
+}
+
+} // namespace cn
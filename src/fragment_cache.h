@@ -0,0 +1,112 @@
+#ifndef __CODENODES_FRAGMENT_CACHE_H__
+#define __CODENODES_FRAGMENT_CACHE_H__
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cn {
+
+struct BuilderOptions;
+
+/// A header a fragment was parsed against, and the hash of its contents at the
+/// time
+struct FragmentDependency
+{
+    std::string path;
+    uint64_t content_hash;
+};
+
+/// One symbol in a fragment. Symbols refer to each other by their index in
+/// Fragment::symbols, and parents always come before their children
+struct FragmentSymbol
+{
+    std::string usr;
+    // unqualified
+    std::string name;
+    uint8_t kind;           // SymbolKind
+    uint8_t aggregate_kind; // ClassSymbol::AggregateKind, if kind is Aggregate
+    // index of the semantic parent, or -1 for the global namespace
+    int64_t parent = -1;
+    // false if the translation unit only saw a forward declaration, or this
+    // symbol is only here because something else references it
+    bool filled = false;
+    // the translation unit had a declaration of it in scope, see
+    // Symbol::in_scope
+    bool in_scope = false;
+    // the symbols each collection of the class or function refers to, in
+    // order. each is restored as its own type, which loses pointers and
+    // references but produces the same edges
+    std::vector<uint32_t> type_refs;
+    std::vector<uint32_t> parent_classes;
+    std::vector<uint32_t> field_types;
+    std::vector<uint32_t> inner_classes;
+    std::vector<uint32_t> member_functions;
+    std::vector<uint32_t> inner_enums;
+    std::vector<uint32_t> parameter_types;
+    bool has_return_type = false;
+    std::vector<uint32_t> return_type;
+    // false unless the translation unit had the function's body. callees and
+    // call_counts line up, see FunctionSymbol::calls
+    bool has_calls = false;
+    std::vector<uint32_t> callees;
+    std::vector<uint32_t> call_counts;
+};
+
+/// Everything one translation unit added to the graph
+struct Fragment
+{
+    uint32_t version;
+    std::string main_file;
+    // every header the translation unit included
+    std::vector<FragmentDependency> dependencies;
+    std::vector<FragmentSymbol> symbols;
+};
+
+/// On-disk cache of one Fragment per translation unit, so that translation
+/// units which did not change since the last run are not parsed again. Thread
+/// safe.
+class FragmentCache
+{
+  public:
+    /// bump whenever Fragment or what goes into a key changes
+    static constexpr uint32_t version = 4;
+
+    /// directory is created if needed
+    explicit FragmentCache(std::string directory) noexcept;
+
+    /// Identifies the fragment for a translation unit from the contents of
+    /// its main file and everything that affects how it is parsed or which
+    /// declarations are kept. Nullopt if the file can't be read
+    [[nodiscard]] std::optional<uint64_t>
+    key_for(const char* filename, std::span<const char* const> command_args,
+            const BuilderOptions& options) noexcept;
+
+    /// Nullopt if there is no fragment for the key, or one of the headers it
+    /// depends on changed since it was saved
+    [[nodiscard]] std::optional<Fragment> load(uint64_t key,
+                                               const char* filename) noexcept;
+
+    /// Prints an error and leaves the cache as it was if writing fails
+    void save(uint64_t key, const Fragment& fragment) noexcept;
+
+    /// FNV-1a of a file's contents, only read from disk once per run
+    [[nodiscard]] std::optional<uint64_t>
+    hash_file(const std::string& path) noexcept;
+
+  private:
+    [[nodiscard]] std::string path_for(uint64_t key) const;
+
+    std::string m_directory;
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::optional<uint64_t>> m_file_hashes;
+};
+
+} // namespace cn
+
+#endif
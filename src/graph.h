@@ -0,0 +1,346 @@
+#ifndef __CODENODES_GRAPH_H__
+#define __CODENODES_GRAPH_H__
+
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cn {
+
+enum class SymbolKind : uint8_t
+{
+    Namespace,
+    Function,
+    Enum,
+    Aggregate, // union, class, struct
+};
+
+/// A node has at most one edge of each kind to each other node, weighted by
+/// how many times it came up, like the number of fields of one type
+enum class EdgeKind : uint8_t
+{
+    // namespace to everything declared directly inside of it
+    Contains,
+    // class to its inner classes, enums, and member functions
+    Member,
+    // class to the types named in its body
+    TypeRef,
+    // class to the types of its fields
+    Field,
+    // class to its base classes
+    Base,
+    // function to the types of its parameters
+    Parameter,
+    // function to its return type
+    Return,
+    // function to every function its body calls, weighted by the number of
+    // call sites
+    Call,
+};
+
+[[nodiscard]] constexpr std::string_view symbol_kind_name(SymbolKind kind)
+{
+    switch (kind) {
+    case SymbolKind::Namespace:
+        return "namespace";
+    case SymbolKind::Function:
+        return "function";
+    case SymbolKind::Enum:
+        return "enum";
+    case SymbolKind::Aggregate:
+        return "aggregate";
+    }
+    return "unknown";
+}
+
+[[nodiscard]] constexpr std::string_view edge_kind_name(EdgeKind kind)
+{
+    switch (kind) {
+    case EdgeKind::Contains:
+        return "contains";
+    case EdgeKind::Member:
+        return "member";
+    case EdgeKind::TypeRef:
+        return "typeref";
+    case EdgeKind::Field:
+        return "field";
+    case EdgeKind::Base:
+        return "base";
+    case EdgeKind::Parameter:
+        return "parameter";
+    case EdgeKind::Return:
+        return "return";
+    case EdgeKind::Call:
+        return "call";
+    }
+    return "unknown";
+}
+
+/// Index of a node in a Graph
+using NodeId = uint32_t;
+
+/// Parent of nodes declared at global scope, and of the root itself
+inline constexpr NodeId no_node = std::numeric_limits<NodeId>::max();
+
+/// Read only access to a graph in compressed sparse rows, wherever its arrays
+/// live. Node attributes are kept in one array each, and the edges of every
+/// node are contiguous, in both directions. Node 0 is the global namespace,
+/// and nodes are in order of USR
+struct GraphView
+{
+    [[nodiscard]] size_t num_nodes() const { return kinds.size(); }
+    [[nodiscard]] size_t num_edges() const { return edge_targets.size(); }
+
+    /// Spelling of just this node, see append_qualified_name
+    [[nodiscard]] std::string_view name(NodeId node) const
+    {
+        const uint32_t id = name_ids[node];
+        return name_bytes.substr(name_offsets[id],
+                                 name_offsets[id + 1] - name_offsets[id]);
+    }
+
+    /// Appends the name qualified by every parent, like outer::inner::name
+    void append_qualified_name(NodeId node, std::string& out) const
+    {
+        append_qualified_name(node, out, out.size());
+    }
+
+    /// Empty for the global namespace
+    [[nodiscard]] std::string_view usr(NodeId node) const
+    {
+        return usr_bytes.substr(usr_offsets[node],
+                                usr_offsets[node + 1] - usr_offsets[node]);
+    }
+
+    /// The node with this USR, or no_node
+    [[nodiscard]] NodeId find_usr(std::string_view wanted) const
+    {
+        // nodes are sorted by USR, and the global namespace's is empty so it
+        // sorts first as well
+        NodeId low = 0;
+        auto high = static_cast<NodeId>(num_nodes());
+        while (low < high) {
+            const NodeId middle = low + ((high - low) / 2);
+            if (usr(middle) < wanted) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low < num_nodes() && usr(low) == wanted ? low : no_node;
+    }
+
+    /// Nodes this one refers to, in output order
+    [[nodiscard]] std::span<const NodeId> targets(NodeId node) const
+    {
+        return edge_targets.subspan(edge_offsets[node],
+                                    edge_offsets[node + 1] -
+                                        edge_offsets[node]);
+    }
+
+    /// Kind of each edge in targets(node)
+    [[nodiscard]] std::span<const EdgeKind> target_kinds(NodeId node) const
+    {
+        return edge_kinds.subspan(edge_offsets[node],
+                                  edge_offsets[node + 1] - edge_offsets[node]);
+    }
+
+    /// How many times each edge in targets(node) occurs, like the number of
+    /// call sites
+    [[nodiscard]] std::span<const uint32_t> target_weights(NodeId node) const
+    {
+        return edge_weights.subspan(edge_offsets[node],
+                                    edge_offsets[node + 1] -
+                                        edge_offsets[node]);
+    }
+
+    /// Nodes which refer to this one, in order of NodeId
+    [[nodiscard]] std::span<const NodeId> sources(NodeId node) const
+    {
+        return reverse_sources.subspan(reverse_offsets[node],
+                                       reverse_offsets[node + 1] -
+                                           reverse_offsets[node]);
+    }
+
+    /// Kind of each edge in sources(node)
+    [[nodiscard]] std::span<const EdgeKind> source_kinds(NodeId node) const
+    {
+        return reverse_kinds.subspan(reverse_offsets[node],
+                                     reverse_offsets[node + 1] -
+                                         reverse_offsets[node]);
+    }
+
+    /// Weight of each edge in sources(node)
+    [[nodiscard]] std::span<const uint32_t> source_weights(NodeId node) const
+    {
+        return reverse_weights.subspan(reverse_offsets[node],
+                                       reverse_offsets[node + 1] -
+                                           reverse_offsets[node]);
+    }
+
+    // per node
+    std::span<const SymbolKind> kinds;
+    // semantic parent, or no_node
+    std::span<const NodeId> parents;
+    std::span<const uint32_t> name_ids;
+    // USR of node n is usr_bytes[usr_offsets[n], usr_offsets[n + 1])
+    std::span<const uint32_t> usr_offsets;
+    std::string_view usr_bytes;
+
+    // name n is name_bytes[name_offsets[n], name_offsets[n + 1])
+    std::span<const uint32_t> name_offsets;
+    std::string_view name_bytes;
+
+    // edges of node n are [edge_offsets[n], edge_offsets[n + 1]), so there is
+    // one more offset than there are nodes
+    std::span<const uint32_t> edge_offsets;
+    std::span<const NodeId> edge_targets;
+    std::span<const EdgeKind> edge_kinds;
+    std::span<const uint32_t> edge_weights;
+
+    // same layout, indexed by target
+    std::span<const uint32_t> reverse_offsets;
+    std::span<const NodeId> reverse_sources;
+    std::span<const EdgeKind> reverse_kinds;
+    std::span<const uint32_t> reverse_weights;
+
+  private:
+    // parents with an empty name, like anonymous namespaces, still get a
+    // separator, but nothing goes before the outermost name
+    void append_qualified_name(NodeId node, std::string& out,
+                               size_t start) const
+    {
+        if (const NodeId parent = parents[node]; parent != no_node) {
+            append_qualified_name(parent, out, start);
+            if (out.size() != start) {
+                out.append("::");
+            }
+        }
+        out.append(name(node));
+    }
+};
+
+/// The symbol forest lowered into a GraphView's arrays, for everything that
+/// runs once parsing is done
+struct Graph
+{
+    explicit Graph(std::pmr::polymorphic_allocator<> allocator)
+        : kinds(allocator), parents(allocator), name_ids(allocator),
+          usr_offsets(allocator), usr_bytes(allocator),
+          name_offsets(allocator), name_bytes(allocator),
+          edge_offsets(allocator), edge_targets(allocator),
+          edge_kinds(allocator), edge_weights(allocator),
+          reverse_offsets(allocator), reverse_sources(allocator),
+          reverse_kinds(allocator), reverse_weights(allocator)
+    {
+    }
+
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+    Graph(Graph&&) noexcept = default;
+    Graph& operator=(Graph&&) noexcept = default;
+    ~Graph() = default;
+
+    [[nodiscard]] size_t num_nodes() const { return kinds.size(); }
+    [[nodiscard]] size_t num_edges() const { return edge_targets.size(); }
+
+    /// Only valid until the graph is modified
+    [[nodiscard]] GraphView view() const
+    {
+        return {
+            .kinds = kinds,
+            .parents = parents,
+            .name_ids = name_ids,
+            .usr_offsets = usr_offsets,
+            .usr_bytes = usr_bytes,
+            .name_offsets = name_offsets,
+            .name_bytes = name_bytes,
+            .edge_offsets = edge_offsets,
+            .edge_targets = edge_targets,
+            .edge_kinds = edge_kinds,
+            .edge_weights = edge_weights,
+            .reverse_offsets = reverse_offsets,
+            .reverse_sources = reverse_sources,
+            .reverse_kinds = reverse_kinds,
+            .reverse_weights = reverse_weights,
+        };
+    }
+
+    /// Gives the next node its USR. Nodes have to be added in order of USR
+    void add_usr(std::string_view usr)
+    {
+        if (usr_offsets.empty()) {
+            usr_offsets.push_back(0);
+        }
+        usr_bytes.append(usr);
+        usr_offsets.push_back(static_cast<uint32_t>(usr_bytes.size()));
+    }
+
+    /// Adds a string to the name table and returns its id
+    uint32_t add_name(std::string_view name)
+    {
+        if (name_offsets.empty()) {
+            name_offsets.push_back(0);
+        }
+        name_bytes.append(name);
+        name_offsets.push_back(static_cast<uint32_t>(name_bytes.size()));
+        return static_cast<uint32_t>(name_offsets.size() - 2);
+    }
+
+    /// Fills in the reverse edges from the forward ones. Call once every
+    /// forward edge has been added
+    void build_reverse_edges()
+    {
+        const size_t count = num_nodes();
+        reverse_offsets.assign(count + 1, 0);
+        for (const NodeId target : edge_targets) {
+            ++reverse_offsets[target + 1];
+        }
+        for (size_t node = 0; node < count; ++node) {
+            reverse_offsets[node + 1] += reverse_offsets[node];
+        }
+
+        // sources are visited in order, so each node's sources come out
+        // sorted
+        std::pmr::vector<uint32_t> cursor{reverse_offsets.begin(),
+                                          reverse_offsets.end() - 1,
+                                          reverse_offsets.get_allocator()};
+        reverse_sources.resize(num_edges());
+        reverse_kinds.resize(num_edges());
+        reverse_weights.resize(num_edges());
+        for (NodeId source = 0; source < count; ++source) {
+            for (uint32_t edge = edge_offsets[source];
+                 edge < edge_offsets[source + 1]; ++edge) {
+                const uint32_t slot = cursor[edge_targets[edge]]++;
+                reverse_sources[slot] = source;
+                reverse_kinds[slot] = edge_kinds[edge];
+                reverse_weights[slot] = edge_weights[edge];
+            }
+        }
+    }
+
+    // see GraphView for what each of these hold
+    std::pmr::vector<SymbolKind> kinds;
+    std::pmr::vector<NodeId> parents;
+    std::pmr::vector<uint32_t> name_ids;
+    std::pmr::vector<uint32_t> usr_offsets;
+    std::pmr::string usr_bytes;
+    std::pmr::vector<uint32_t> name_offsets;
+    std::pmr::string name_bytes;
+    std::pmr::vector<uint32_t> edge_offsets;
+    std::pmr::vector<NodeId> edge_targets;
+    std::pmr::vector<EdgeKind> edge_kinds;
+    std::pmr::vector<uint32_t> edge_weights;
+    std::pmr::vector<uint32_t> reverse_offsets;
+    std::pmr::vector<NodeId> reverse_sources;
+    std::pmr::vector<EdgeKind> reverse_kinds;
+    std::pmr::vector<uint32_t> reverse_weights;
+};
+
+} // namespace cn
+
+#endif
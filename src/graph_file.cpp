@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "buffered_writer.h"
+#include "graph_file.h"
+
+namespace cn {
+
+namespace {
+static_assert(std::is_trivially_copyable_v<GraphFileHeader> &&
+              sizeof(GraphFileHeader) % 8 == 0);
+
+constexpr uint64_t section_alignment = 8;
+
+constexpr uint64_t align_up(uint64_t size)
+{
+    return (size + section_alignment - 1) & ~(section_alignment - 1);
+}
+
+template <typename T> std::string_view bytes_of(std::span<const T> array)
+{
+    return {reinterpret_cast<const char*>(array.data()), array.size_bytes()};
+}
+
+/// Offset arrays always have one more entry than what they index, even when
+/// that is nothing
+std::string_view offsets_bytes(std::span<const uint32_t> offsets)
+{
+    static constexpr uint32_t none = 0;
+    return bytes_of(offsets.empty() ? std::span{&none, 1} : offsets);
+}
+
+/// Points out at the given section, if it holds exactly count elements and
+/// lies within the file
+template <typename T>
+bool map_section(const GraphFileHeader& header, std::string_view file,
+                 GraphFileSection which, uint64_t count,
+                 std::span<const T>& out)
+{
+    const GraphFileHeader::Section& section =
+        header.sections[static_cast<size_t>(which)];
+    if (section.offset % section_alignment != 0 ||
+        section.offset > file.size() ||
+        section.size > file.size() - section.offset ||
+        section.size % sizeof(T) != 0 || section.size / sizeof(T) != count) {
+        return false;
+    }
+    out = {reinterpret_cast<const T*>(file.data() + section.offset), count};
+    return true;
+}
+
+/// Every index the view hands out stays within what it indexes, and walking
+/// up the parents always ends at a root. The sections are already known to
+/// have the right sizes, and every offset array to end at the size of what
+/// it indexes
+bool is_consistent(const GraphView& view, uint64_t num_names)
+{
+    const size_t num_nodes = view.num_nodes();
+    const auto in_range = [](std::span<const NodeId> nodes, uint64_t count) {
+        return std::ranges::all_of(
+            nodes, [count](NodeId node) { return node < count; });
+    };
+    if (!std::ranges::is_sorted(view.usr_offsets) ||
+        !std::ranges::is_sorted(view.name_offsets) ||
+        !std::ranges::is_sorted(view.edge_offsets) ||
+        !std::ranges::is_sorted(view.reverse_offsets) ||
+        !in_range(view.name_ids, num_names) ||
+        !in_range(view.edge_targets, num_nodes) ||
+        !in_range(view.reverse_sources, num_nodes) ||
+        !std::ranges::all_of(view.parents, [num_nodes](NodeId parent) {
+            return parent == no_node || parent < num_nodes;
+        })) {
+        return false;
+    }
+
+    // a cycle of parents would have append_qualified_name recurse forever.
+    // Each node is walked up from once, until a node that is known to reach a
+    // root, or one on the current walk, which means there is a cycle
+    enum class Walk : uint8_t
+    {
+        NotYet,
+        Current,
+        ReachesRoot,
+    };
+    std::vector<Walk> walks(num_nodes, Walk::NotYet);
+    for (NodeId start = 0; start < num_nodes; ++start) {
+        NodeId node = start;
+        while (node != no_node && walks[node] == Walk::NotYet) {
+            walks[node] = Walk::Current;
+            node = view.parents[node];
+        }
+        if (node != no_node && walks[node] == Walk::Current) {
+            return false;
+        }
+        for (node = start; node != no_node && walks[node] == Walk::Current;
+             node = view.parents[node]) {
+            walks[node] = Walk::ReachesRoot;
+        }
+    }
+    return true;
+}
+} // namespace
+
+bool write_graph_file(const GraphView& graph, std::ostream& output) noexcept
+{
+    std::array<std::string_view, static_cast<size_t>(GraphFileSection::Count)>
+        sections{};
+    auto section = [&sections](GraphFileSection which) -> std::string_view& {
+        return sections[static_cast<size_t>(which)];
+    };
+    section(GraphFileSection::Kinds) = bytes_of(graph.kinds);
+    section(GraphFileSection::Parents) = bytes_of(graph.parents);
+    section(GraphFileSection::NameIds) = bytes_of(graph.name_ids);
+    section(GraphFileSection::UsrOffsets) = offsets_bytes(graph.usr_offsets);
+    section(GraphFileSection::UsrBytes) = graph.usr_bytes;
+    section(GraphFileSection::NameOffsets) = offsets_bytes(graph.name_offsets);
+    section(GraphFileSection::NameBytes) = graph.name_bytes;
+    section(GraphFileSection::EdgeOffsets) = offsets_bytes(graph.edge_offsets);
+    section(GraphFileSection::EdgeTargets) = bytes_of(graph.edge_targets);
+    section(GraphFileSection::EdgeKinds) = bytes_of(graph.edge_kinds);
+    section(GraphFileSection::EdgeWeights) = bytes_of(graph.edge_weights);
+    section(GraphFileSection::ReverseOffsets) =
+        offsets_bytes(graph.reverse_offsets);
+    section(GraphFileSection::ReverseSources) = bytes_of(graph.reverse_sources);
+    section(GraphFileSection::ReverseKinds) = bytes_of(graph.reverse_kinds);
+    section(GraphFileSection::ReverseWeights) = bytes_of(graph.reverse_weights);
+
+    GraphFileHeader header{};
+    header.magic = GraphFileHeader::expected_magic;
+    header.version = GraphFileHeader::current_version;
+    header.byte_order = GraphFileHeader::expected_byte_order;
+    header.num_nodes = graph.num_nodes();
+    header.num_names =
+        graph.name_offsets.empty() ? 0 : graph.name_offsets.size() - 1;
+    header.num_edges = graph.num_edges();
+    uint64_t offset = sizeof(GraphFileHeader);
+    for (size_t i = 0; i < sections.size(); ++i) {
+        header.sections[i] = {.offset = offset, .size = sections[i].size()};
+        offset = align_up(offset + sections[i].size());
+    }
+
+    static constexpr std::array<char, section_alignment> padding{};
+    BufferedWriter writer(output);
+    writer.write({reinterpret_cast<const char*>(&header), sizeof(header)});
+    for (const std::string_view bytes : sections) {
+        writer.write(bytes);
+        writer.write({padding.data(), align_up(bytes.size()) - bytes.size()});
+    }
+    return writer.flush();
+}
+
+std::optional<GraphFile> GraphFile::open(const std::string& path) noexcept
+{
+    // queries jump around the file rather than reading it in order
+    auto file = MappedFile::open(path, MADV_RANDOM);
+    if (!file.has_value()) {
+        std::ignore =
+            fprintf(stderr, "Unable to open graph file %s\n", path.c_str());
+        return {};
+    }
+
+    const std::string_view bytes = file->view();
+    GraphFileHeader header{};
+    if (bytes.size() < sizeof(header)) {
+        std::ignore = fprintf(stderr, "%s is not a graph file\n", path.c_str());
+        return {};
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != GraphFileHeader::expected_magic) {
+        std::ignore = fprintf(stderr, "%s is not a graph file\n", path.c_str());
+        return {};
+    }
+    if (header.byte_order != GraphFileHeader::expected_byte_order) {
+        std::ignore = fprintf(
+            stderr, "Graph file %s was written with another byte order\n",
+            path.c_str());
+        return {};
+    }
+    if (header.version != GraphFileHeader::current_version) {
+        std::ignore = fprintf(stderr,
+                              "Graph file %s is version %u, expected %u\n",
+                              path.c_str(), header.version,
+                              GraphFileHeader::current_version);
+        return {};
+    }
+
+    // the counts come from the file, so they are only trusted once every
+    // section was checked to be that long. Then the contents are checked once
+    // here, so that nothing reading the view has to
+    const auto section_size = [&header](GraphFileSection which) {
+        return header.sections[static_cast<size_t>(which)].size;
+    };
+    const uint64_t usr_bytes_size = section_size(GraphFileSection::UsrBytes);
+    const uint64_t name_bytes_size = section_size(GraphFileSection::NameBytes);
+    std::span<const char> usr_bytes;
+    std::span<const char> name_bytes;
+    GraphView view;
+    const bool mapped =
+        header.num_nodes < no_node && header.num_names < no_node &&
+        header.num_edges <= no_node &&
+        map_section(header, bytes, GraphFileSection::Kinds, header.num_nodes,
+                    view.kinds) &&
+        map_section(header, bytes, GraphFileSection::Parents, header.num_nodes,
+                    view.parents) &&
+        map_section(header, bytes, GraphFileSection::NameIds,
+                    header.num_nodes, view.name_ids) &&
+        map_section(header, bytes, GraphFileSection::UsrOffsets,
+                    header.num_nodes + 1, view.usr_offsets) &&
+        map_section(header, bytes, GraphFileSection::UsrBytes,
+                    usr_bytes_size, usr_bytes) &&
+        map_section(header, bytes, GraphFileSection::NameOffsets,
+                    header.num_names + 1, view.name_offsets) &&
+        map_section(header, bytes, GraphFileSection::NameBytes,
+                    name_bytes_size, name_bytes) &&
+        map_section(header, bytes, GraphFileSection::EdgeOffsets,
+                    header.num_nodes + 1, view.edge_offsets) &&
+        map_section(header, bytes, GraphFileSection::EdgeTargets,
+                    header.num_edges, view.edge_targets) &&
+        map_section(header, bytes, GraphFileSection::EdgeKinds,
+                    header.num_edges, view.edge_kinds) &&
+        map_section(header, bytes, GraphFileSection::EdgeWeights,
+                    header.num_edges, view.edge_weights) &&
+        map_section(header, bytes, GraphFileSection::ReverseOffsets,
+                    header.num_nodes + 1, view.reverse_offsets) &&
+        map_section(header, bytes, GraphFileSection::ReverseSources,
+                    header.num_edges, view.reverse_sources) &&
+        map_section(header, bytes, GraphFileSection::ReverseKinds,
+                    header.num_edges, view.reverse_kinds) &&
+        map_section(header, bytes, GraphFileSection::ReverseWeights,
+                    header.num_edges, view.reverse_weights) &&
+        view.usr_offsets.back() == usr_bytes_size &&
+        view.name_offsets.back() == name_bytes_size &&
+        view.edge_offsets.back() == header.num_edges &&
+        view.reverse_offsets.back() == header.num_edges &&
+        is_consistent(view, header.num_names);
+    if (!mapped) {
+        std::ignore = fprintf(stderr, "Graph file %s is truncated or corrupt\n",
+                              path.c_str());
+        return {};
+    }
+    view.usr_bytes = {usr_bytes.data(), usr_bytes.size()};
+    view.name_bytes = {name_bytes.data(), name_bytes.size()};
+
+    return GraphFile(std::move(file).value(), view);
+}
+
+} // namespace cn
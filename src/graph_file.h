@@ -0,0 +1,102 @@
+#ifndef __CODENODES_GRAPH_FILE_H__
+#define __CODENODES_GRAPH_FILE_H__
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+
+#include "graph.h"
+#include "mapped_file.h"
+
+namespace cn {
+
+/// The arrays of a GraphView, in the order they are laid out in a graph file
+enum class GraphFileSection : uint8_t
+{
+    Kinds,
+    Parents,
+    NameIds,
+    UsrOffsets,
+    UsrBytes,
+    NameOffsets,
+    NameBytes,
+    EdgeOffsets,
+    EdgeTargets,
+    EdgeKinds,
+    EdgeWeights,
+    ReverseOffsets,
+    ReverseSources,
+    ReverseKinds,
+    ReverseWeights,
+    Count,
+};
+
+/// Start of a graph file. Every section is an array of the same type as its
+/// GraphView member, in the writer's byte order, at an offset from the start
+/// of the file which is a multiple of 8. The file is used in place, so
+/// anything that changes this layout must bump version
+struct GraphFileHeader
+{
+    static constexpr std::array<char, 8> expected_magic{"CNGRAPH"};
+    static constexpr uint32_t current_version = 3;
+    // reads back differently on a machine with the other byte order
+    static constexpr uint32_t expected_byte_order = 0x01020304;
+
+    struct Section
+    {
+        // both in bytes
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t num_nodes;
+    uint64_t num_names;
+    uint64_t num_edges;
+    std::array<Section, static_cast<size_t>(GraphFileSection::Count)>
+        sections;
+};
+
+/// Writes the graph in the format described by GraphFileHeader, which
+/// GraphFile can use without parsing. output should be opened in binary mode.
+/// False if the stream failed
+[[nodiscard]] bool write_graph_file(const GraphView& graph,
+                                    std::ostream& output) noexcept;
+
+/// A graph file mapped into memory. Opening checks that the header matches,
+/// that every section fits in the file, and that every index in them is in
+/// range, which reads every section once. Nothing is copied
+class GraphFile
+{
+  public:
+    /// Prints why and returns nothing if the file can't be used
+    [[nodiscard]] static std::optional<GraphFile>
+    open(const std::string& path) noexcept;
+
+    GraphFile(const GraphFile&) = delete;
+    GraphFile& operator=(const GraphFile&) = delete;
+    GraphFile(GraphFile&&) noexcept = default;
+    GraphFile& operator=(GraphFile&&) = delete;
+    ~GraphFile() = default;
+
+    /// Valid for as long as this is
+    [[nodiscard]] const GraphView& view() const { return m_view; }
+
+  private:
+    GraphFile(MappedFile file, const GraphView& view)
+        : m_file(std::move(file)), m_view(view)
+    {
+    }
+
+    MappedFile m_file;
+    // points into m_file
+    GraphView m_view;
+};
+
+} // namespace cn
+
+#endif
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <condition_variable>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffered_writer.h"
+#include "graphml_writer.h"
+
+namespace cn {
+
+namespace {
+/// Replacement for every byte that can't appear as is in attribute values or
+/// text, empty for everything else
+constexpr std::array<std::string_view, 256> xml_escapes = [] {
+    std::array<std::string_view, 256> out{};
+    out['&'] = "&amp;";
+    out['<'] = "&lt;";
+    out['>'] = "&gt;";
+    out['"'] = "&quot;";
+    out['\''] = "&apos;";
+    return out;
+}();
+
+// roughly what a chunk's worth of output costs to format, a few hundred
+// kilobytes
+constexpr size_t nodes_per_chunk = size_t{1} << 13;
+constexpr size_t edges_per_chunk = size_t{1} << 14;
+
+/// Nodes or the edges of nodes in [begin, end), formatted on their own
+struct Chunk
+{
+    bool edges;
+    NodeId begin;
+    NodeId end;
+};
+
+void append_escaped(std::string& out, std::string_view text)
+{
+    size_t run_begin = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        const std::string_view escape =
+            xml_escapes[static_cast<unsigned char>(text[i])];
+        if (escape.empty()) {
+            continue;
+        }
+        out.append(text.substr(run_begin, i - run_begin));
+        out.append(escape);
+        run_begin = i + 1;
+    }
+    out.append(text.substr(run_begin));
+}
+
+void append_node_id(std::string& out, NodeId node)
+{
+    std::array<char, 16> digits{};
+    char* end =
+        std::to_chars(digits.data(), digits.data() + digits.size(), node).ptr;
+    out.push_back('n');
+    out.append(digits.data(), end);
+}
+
+void format_chunk(const GraphView& graph, const Chunk& chunk,
+                  std::string& out, std::string& name)
+{
+    if (!chunk.edges) {
+        for (NodeId node = chunk.begin; node < chunk.end; ++node) {
+            name.clear();
+            graph.append_qualified_name(node, name);
+
+            out.append("<node id=\"");
+            append_node_id(out, node);
+            out.append("\"><data key=\"name\">");
+            append_escaped(out, name);
+            out.append("</data><data key=\"kind\">");
+            out.append(symbol_kind_name(graph.kinds[node]));
+            out.append("</data></node>\n");
+        }
+        return;
+    }
+
+    for (NodeId node = chunk.begin; node < chunk.end; ++node) {
+        const auto targets = graph.targets(node);
+        const auto kinds = graph.target_kinds(node);
+        const auto weights = graph.target_weights(node);
+        for (size_t i = 0; i < targets.size(); ++i) {
+            out.append("<edge source=\"");
+            append_node_id(out, node);
+            out.append("\" target=\"");
+            append_node_id(out, targets[i]);
+            out.append("\"><data key=\"edge_kind\">");
+            out.append(edge_kind_name(kinds[i]));
+            out.append("</data>");
+            // most edges keep the default
+            if (weights[i] != 1) {
+                std::array<char, 16> digits{};
+                char* end = std::to_chars(digits.data(),
+                                          digits.data() + digits.size(),
+                                          weights[i])
+                                .ptr;
+                out.append("<data key=\"weight\">");
+                out.append(digits.data(), end);
+                out.append("</data>");
+            }
+            out.append("</edge>\n");
+        }
+    }
+}
+
+/// Every node, then every edge. Edge chunks are cut by number of edges, since
+/// a few nodes have most of them
+std::vector<Chunk> split_into_chunks(const GraphView& graph)
+{
+    std::vector<Chunk> out;
+    const auto num_nodes = static_cast<NodeId>(graph.num_nodes());
+    for (NodeId begin = 0; begin < num_nodes; begin += nodes_per_chunk) {
+        out.push_back({
+            .edges = false,
+            .begin = begin,
+            .end = static_cast<NodeId>(
+                std::min<size_t>(begin + nodes_per_chunk, num_nodes)),
+        });
+    }
+
+    NodeId begin = 0;
+    for (NodeId node = 0; node < num_nodes; ++node) {
+        if (graph.edge_offsets[node + 1] - graph.edge_offsets[begin] >=
+            edges_per_chunk) {
+            out.push_back({.edges = true, .begin = begin, .end = node + 1});
+            begin = node + 1;
+        }
+    }
+    if (begin < num_nodes) {
+        out.push_back({.edges = true, .begin = begin, .end = num_nodes});
+    }
+    return out;
+}
+
+/// Formats chunks on worker threads while the calling thread writes them out
+/// in order. Only a few chunks ahead of the writer are kept in memory at once
+class ChunkPipeline
+{
+  public:
+    ChunkPipeline(const GraphView& graph, std::span<const Chunk> chunks,
+                  size_t num_threads)
+        : m_graph(graph), m_chunks(chunks), m_window(num_threads * 2),
+          m_buffers(m_window), m_ready(m_window, false)
+    {
+        m_threads.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; ++i) {
+            m_threads.emplace_back([this] { work(); });
+        }
+    }
+
+    ChunkPipeline(const ChunkPipeline&) = delete;
+    ChunkPipeline& operator=(const ChunkPipeline&) = delete;
+    ChunkPipeline(ChunkPipeline&&) = delete;
+    ChunkPipeline& operator=(ChunkPipeline&&) = delete;
+
+    ~ChunkPipeline()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_next = m_chunks.size();
+        }
+        m_condition.notify_all();
+    }
+
+    void write_all(BufferedWriter& writer)
+    {
+        for (size_t i = 0; i < m_chunks.size(); ++i) {
+            const size_t slot = i % m_window;
+            {
+                std::unique_lock lock(m_mutex);
+                m_condition.wait(lock, [&] { return m_ready[slot]; });
+            }
+            writer.write(m_buffers[slot]);
+            {
+                std::lock_guard lock(m_mutex);
+                m_ready[slot] = false;
+                ++m_written;
+            }
+            m_condition.notify_all();
+        }
+    }
+
+  private:
+    void work()
+    {
+        std::string name;
+        while (true) {
+            size_t index = 0;
+            {
+                std::unique_lock lock(m_mutex);
+                // the slot is free once the chunk a window back was written
+                m_condition.wait(lock, [this] {
+                    return m_next >= m_chunks.size() ||
+                           m_next < m_written + m_window;
+                });
+                if (m_next >= m_chunks.size()) {
+                    return;
+                }
+                index = m_next++;
+            }
+
+            std::string& buffer = m_buffers[index % m_window];
+            buffer.clear();
+            format_chunk(m_graph, m_chunks[index], buffer, name);
+
+            {
+                std::lock_guard lock(m_mutex);
+                m_ready[index % m_window] = true;
+            }
+            m_condition.notify_all();
+        }
+    }
+
+    const GraphView& m_graph;
+    std::span<const Chunk> m_chunks;
+    size_t m_window;
+    // one per chunk in flight, reused for the chunk a window later
+    std::vector<std::string> m_buffers;
+    std::vector<bool> m_ready;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    size_t m_next = 0;
+    size_t m_written = 0;
+    // last, so that they are joined before anything above is destroyed
+    std::vector<std::jthread> m_threads;
+};
+} // namespace
+
+bool write_graphml(const GraphView& graph, std::ostream& output,
+                   size_t num_threads) noexcept
+{
+    // follows http://graphml.graphdrawing.org/primer/graphml-primer.html
+    BufferedWriter writer(output);
+    writer.write(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\" "
+        "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+        "xsi:schemaLocation=\"http://graphml.graphdrawing.org/xmlns "
+        "http://graphml.graphdrawing.org/xmlns/1.0/graphml.xsd\">\n"
+        "<key id=\"name\" for=\"node\" attr.name=\"name\" "
+        "attr.type=\"string\"/>\n"
+        "<key id=\"kind\" for=\"node\" attr.name=\"kind\" "
+        "attr.type=\"string\"/>\n"
+        "<key id=\"edge_kind\" for=\"edge\" attr.name=\"kind\" "
+        "attr.type=\"string\"/>\n"
+        "<key id=\"weight\" for=\"edge\" attr.name=\"weight\" "
+        "attr.type=\"int\"><default>1</default></key>\n"
+        "<graph id=\"G\" edgedefault=\"directed\">\n");
+
+    const std::vector<Chunk> chunks = split_into_chunks(graph);
+    if (num_threads <= 1) {
+        std::string buffer;
+        std::string name;
+        for (const Chunk& chunk : chunks) {
+            buffer.clear();
+            format_chunk(graph, chunk, buffer, name);
+            writer.write(buffer);
+        }
+    } else {
+        ChunkPipeline pipeline(graph, chunks, num_threads);
+        pipeline.write_all(writer);
+    }
+
+    writer.write("</graph>\n</graphml>\n");
+    return writer.flush();
+}
+
+} // namespace cn
@@ -0,0 +1,20 @@
+#ifndef __CODENODES_GRAPHML_WRITER_H__
+#define __CODENODES_GRAPHML_WRITER_H__
+
+#include <cstddef>
+#include <ostream>
+
+#include "graph.h"
+
+namespace cn {
+
+/// Streams the graph out as GraphML, one element per line. Node ids are n
+/// followed by the NodeId, the qualified name and kind go in <data> elements.
+/// Formatting is split over num_threads, the output is the same no matter how
+/// many. False if the stream failed
+[[nodiscard]] bool write_graphml(const GraphView& graph, std::ostream& output,
+                                 size_t num_threads = 1) noexcept;
+
+} // namespace cn
+
+#endif
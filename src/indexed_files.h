@@ -0,0 +1,61 @@
+#ifndef __CODENODES_INDEXED_FILES_H__
+#define __CODENODES_INDEXED_FILES_H__
+
+#include <clang-c/Index.h>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <unordered_set>
+
+namespace cn {
+
+/// Files whose declarations have all been turned into symbols by a job which
+/// finished, keyed by clang_getFileUniqueID so that the same header is
+/// recognized from any translation unit. Shared by all jobs in a run.
+class IndexedFileRegistry
+{
+  public:
+    [[nodiscard]] bool contains(const CXFileUniqueID& id) const
+    {
+        std::shared_lock lock(m_mutex);
+        return m_files.contains(id);
+    }
+
+    void insert(std::span<const CXFileUniqueID> ids)
+    {
+        std::unique_lock lock(m_mutex);
+        m_files.insert(ids.begin(), ids.end());
+    }
+
+  private:
+    struct Hash
+    {
+        size_t operator()(const CXFileUniqueID& id) const
+        {
+            size_t hash = 0;
+            for (unsigned long long part : id.data) {
+                hash ^= std::hash<unsigned long long>{}(part) + 0x9e3779b9 +
+                        (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+    };
+
+    struct Equal
+    {
+        bool operator()(const CXFileUniqueID& lhs,
+                        const CXFileUniqueID& rhs) const
+        {
+            return lhs.data[0] == rhs.data[0] && lhs.data[1] == rhs.data[1] &&
+                   lhs.data[2] == rhs.data[2];
+        }
+    };
+
+    mutable std::shared_mutex m_mutex;
+    std::unordered_set<CXFileUniqueID, Hash, Equal> m_files;
+};
+
+} // namespace cn
+
+#endif
@@ -0,0 +1,143 @@
+#include <algorithm>
+
+#include "clang_to_graphml_impl.h"
+
+namespace cn {
+
+namespace {
+void index_declaration(CXClientData client_data, const CXIdxDeclInfo* info)
+{
+    auto* job = static_cast<ClangToGraphMLBuilder::Job*>(client_data);
+    const CXIdxEntityInfo* entity = info->entityInfo;
+
+    // templates are reported with the kind of the declaration they template,
+    // so they have to be told apart here, the visitor sees their own kinds
+    if (entity == nullptr || entity->USR == nullptr ||
+        entity->templateKind != CXIdxEntity_NonTemplate) {
+        return;
+    }
+    if (const auto& status = job->file_status(info->cursor);
+        status.indexed || status.out_of_scope) {
+        return;
+    }
+
+    const std::string_view usr = entity->USR;
+    const enum CXCursorKind kind = clang_getCursorKind(info->cursor);
+    // same as the visitor engine, namespace blocks are not canonicalized
+    const CXCursor cursor = kind == CXCursor_Namespace
+                                ? info->cursor
+                                : clang_getCanonicalCursor(info->cursor);
+
+    // the visitor engine only looks at what is written directly inside a
+    // namespace or at the top level. members and nested classes are reached
+    // through their class, which the class visitor does the same way here,
+    // and anything local to a function body is never reached at all
+    if (info->lexicalContainer == nullptr) {
+        return;
+    }
+    switch (clang_getCursorKind(info->lexicalContainer->cursor)) {
+    case CXCursor_TranslationUnit:
+    case CXCursor_Namespace:
+    case CXCursor_LinkageSpec:
+        break;
+    default:
+        return;
+    }
+
+    // switch on the cursor kind rather than the entity kind, so that we end up
+    // with exactly the symbols the visitor engine would create. templates, for
+    // example, have a class entity kind but a CXCursor_ClassTemplate cursor
+    switch (kind) {
+    case CXCursor_Namespace:
+        job->mark_in_scope(
+            job->create_or_find_symbol_with_usr<NamespaceSymbol>(usr, cursor));
+        break;
+    case CXCursor_FunctionDecl:
+    // only methods defined outside of their class get this far
+    case CXCursor_CXXMethod:
+    case CXCursor_Constructor:
+    case CXCursor_Destructor:
+    case CXCursor_ConversionFunction:
+        if (FunctionSymbol::is_representable(cursor)) {
+            job->mark_in_scope(
+                job->create_or_find_symbol_with_usr<FunctionSymbol>(usr,
+                                                                    cursor));
+        }
+        break;
+    case CXCursor_UnionDecl:
+    case CXCursor_ClassDecl:
+    case CXCursor_StructDecl:
+        job->mark_in_scope(
+            job->create_or_find_symbol_with_usr<ClassSymbol>(usr, cursor));
+        break;
+    case CXCursor_EnumDecl:
+        job->mark_in_scope(
+            job->create_or_find_symbol_with_usr<EnumTypeSymbol>(usr, cursor));
+        break;
+    default:
+        break;
+    }
+}
+
+/// Only set as a callback if there is a max include depth. Headers are
+/// reported here before any of their declarations are
+CXIdxClientFile included_file(CXClientData client_data,
+                              const CXIdxIncludedFileInfo* info)
+{
+    auto* job = static_cast<ClangToGraphMLBuilder::Job*>(client_data);
+
+    CXFile includer = nullptr;
+    clang_indexLoc_getFileLocation(info->hashLoc, nullptr, &includer, nullptr,
+                                   nullptr, nullptr);
+    auto& depth_by_file = job->scratch->include_depth_by_file;
+    // the main file is the only one which is not in the map
+    auto includer_depth = depth_by_file.find(includer);
+    const unsigned depth = includer_depth == depth_by_file.end()
+                               ? 1 - job->main_file_depth()
+                               : includer_depth->second + 1;
+
+    auto [iter, inserted] = depth_by_file.try_emplace(info->file, depth);
+    iter->second = std::min(iter->second, depth);
+    return nullptr;
+}
+} // namespace
+
+void ClangToGraphMLBuilder::Job::run_indexer(
+    CXIndexAction action, const char* filename,
+    std::span<const char* const> command_args) noexcept
+{
+    IndexerCallbacks callbacks{
+        .ppIncludedFile = shared_data->options.max_include_depth.has_value()
+                              ? included_file
+                              : nullptr,
+        .indexDeclaration = index_declaration,
+    };
+
+    // symbol contents (fields, base classes, signatures) are still filled in by
+    // the same visitors as the visitor engine, but only once per symbol, so
+    // the indexer's main saving is in not walking every cursor and not asking
+    // for the USR of declarations it reports
+    CXTranslationUnit unit{};
+    const std::span<CXUnsavedFile> unsaved = unsaved_files(filename);
+    const int error = clang_indexSourceFileFullArgv(
+        action, this, &callbacks, sizeof(callbacks),
+        CXIndexOpt_SkipParsedBodiesInSession, filename, command_args.data(),
+        static_cast<int>(command_args.size()), unsaved.data(),
+        static_cast<unsigned>(unsaved.size()), &unit,
+        translation_unit_flags(shared_data->options.depth));
+
+    if (error != 0 || unit == nullptr) {
+        std::ignore = fprintf(stderr,
+                              "Unable to index translation unit %s due to "
+                              "error code %d, aborting.\n",
+                              filename, error);
+        clang_disposeTranslationUnit(unit);
+        return;
+    }
+
+    report_diagnostics(unit, filename);
+
+    finish_translation_unit(unit);
+}
+
+} // namespace cn
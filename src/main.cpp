@@ -4,9 +4,16 @@
 #include <fstream>
 #include <print>
 #include <ranges>
+#include <thread>
+#include <vector>
 
 #include "clang_to_graphml.h"
+#include "compile_args.h"
 #include "compile_command_entry.h"
+#include "compressed_output.h"
+#include "graph_file.h"
+#include "precompiled_header.h"
+#include "query_server.h"
 
 namespace {
 template <typename LHS, typename RHS>
@@ -18,20 +25,114 @@ constexpr bool string_view_compare(LHS a, RHS b)
 
     return ::memcmp(a.data(), b.data(), std::min(a.size(), b.size())) == 0;
 }
+
+std::vector<std::string> split_globs(std::string_view list)
+{
+    std::vector<std::string> out;
+    for (auto glob : std::views::split(list, ',')) {
+        if (!glob.empty()) {
+            out.emplace_back(std::string_view{glob});
+        }
+    }
+    return out;
+}
+
+constexpr std::string_view version = "0.0.1";
+
+/// codenodes serve, which answers queries against a graph written with
+/// --binary-output until it is killed
+int serve(int argc, const char* argv[])
+{
+    argz::about about{
+        .description = "Serve queries against a graph built earlier with "
+                       "--binary-output on a Unix domain socket. Requests "
+                       "are lines of tab separated fields: lookup, "
+                       "dependents, dependencies or children followed by a "
+                       "symbol, or path followed by two. A symbol is a node "
+                       "id like #42, a USR, or a qualified name.",
+        .version = version,
+        .print_help_when_no_options = true,
+    };
+
+    std::optional<std::string> graph_path{};
+    std::optional<std::string> socket_path{};
+    uint32_t num_jobs = 0;
+    argz::options opts{
+        {
+            .ids = {.id = "graph", .alias = 'g'},
+            .value = graph_path,
+            .help = "path to a graph written with --binary-output",
+        },
+        {
+            .ids = {.id = "socket", .alias = 's'},
+            .value = socket_path,
+            .help = "path to create the socket at",
+        },
+        {
+            .ids = {.id = "jobs", .alias = 'j'},
+            .value = num_jobs,
+            .help = "number of connections to serve at once, or 0 to use "
+                    "one per hardware thread",
+        },
+    };
+
+    try {
+        argz::parse(about, opts, argc, argv);
+    } catch (const std::exception& e) {
+        std::ignore =
+            fprintf(stderr, "Bad command line arguments: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (!graph_path.has_value() || !socket_path.has_value()) {
+        std::ignore = fprintf(stderr, "Provide a graph and a socket path\n");
+        return EXIT_FAILURE;
+    }
+
+    const auto graph = cn::GraphFile::open(graph_path.value());
+    if (!graph.has_value()) {
+        return EXIT_FAILURE;
+    }
+
+    if (num_jobs == 0) {
+        num_jobs = std::max(1U, std::thread::hardware_concurrency());
+    }
+    // only comes back if it could not start serving
+    cn::serve_graph(graph->view(), socket_path.value(), num_jobs);
+    return EXIT_FAILURE;
+}
 } // namespace
 
 int main(int argc, const char* argv[])
 {
-    constexpr std::string_view version = "0.0.1";
+    if (argc > 1 && std::string_view{argv[1]} == "serve") {
+        return serve(argc - 1, argv + 1);
+    }
+
     argz::about about{
         .description = "A program to parse a large c++ codebase and "
-                       "visualize it as a graph of connected nodes.",
+                       "visualize it as a graph of connected nodes. "
+                       "`codenodes serve` answers queries against a graph "
+                       "it built earlier.",
         .version = version,
         .print_help_when_no_options = false,
     };
 
     std::optional<std::string> compile_commands_path{};
     std::optional<std::string> output_file_path{};
+    std::optional<std::string> binary_output_path{};
+    std::string compress = "none";
+    std::optional<int32_t> compress_level{};
+    uint32_t num_jobs = 1;
+    std::optional<std::string> pch_directory{};
+    std::optional<std::string> cache_directory{};
+    std::string engine = "visitor";
+    std::string depth = "bodies";
+    std::optional<std::string> include_paths{};
+    std::optional<std::string> exclude_paths{};
+    bool no_system_headers = false;
+    std::optional<uint32_t> max_include_depth{};
+    uint32_t unity_batch = 1;
     argz::options opts{
         {
             .ids = {.id = "compile_commands", .alias = 'c'},
@@ -45,6 +146,99 @@ int main(int argc, const char* argv[])
             .value = output_file_path,
             .help = "path to the output GraphML file",
         },
+        {
+            .ids = {.id = "binary-output"},
+            .value = binary_output_path,
+            .help = "path to write the graph to in codenodes' binary format, "
+                    "which can be memory mapped and read without parsing. "
+                    "may be given with or instead of --output",
+        },
+        {
+            .ids = {.id = "compress"},
+            .value = compress,
+            .help = "compress the GraphML output with `zstd` or `gzip` as it "
+                    "is written, on a thread of its own. `none` by default",
+        },
+        {
+            .ids = {.id = "compress-level"},
+            .value = compress_level,
+            .help = "compression level, on the compressor's own scale. its "
+                    "default if not given",
+        },
+        {
+            .ids = {.id = "jobs", .alias = 'j'},
+            .value = num_jobs,
+            .help = "number of translation units to parse in parallel, or 0 "
+                    "to use one per hardware thread. the output is the same "
+                    "regardless of this setting",
+        },
+        {
+            .ids = {.id = "pch-dir"},
+            .value = pch_directory,
+            .help = "directory to build precompiled headers into. translation "
+                    "units which share compiler flags get one containing the "
+                    "#includes they all start with. off if not given",
+        },
+        {
+            .ids = {.id = "cache-dir"},
+            .value = cache_directory,
+            .help = "directory to cache what was found in each translation "
+                    "unit in. translation units whose file, headers and "
+                    "flags did not change since the last run are loaded from "
+                    "here instead of parsed. off if not given",
+        },
+        {
+            .ids = {.id = "engine"},
+            .value = engine,
+            .help = "how declarations are found, either `visitor` "
+                    "(clang_visitChildren) or `indexer` "
+                    "(clang_indexSourceFile)",
+        },
+        {
+            .ids = {.id = "depth"},
+            .value = depth,
+            .help = "how much of each file to parse. `decls` only finds what "
+                    "declares what, `signatures` adds field, base class, and "
+                    "function parameter and return types, `bodies` also "
+                    "records which functions each function body calls. the "
+                    "first two skip bodies entirely and are much faster",
+        },
+        {
+            .ids = {.id = "include-path"},
+            .value = include_paths,
+            .help = "comma separated globs. if given, only declarations in "
+                    "files whose absolute path matches one of them become "
+                    "nodes",
+        },
+        {
+            .ids = {.id = "exclude-path"},
+            .value = exclude_paths,
+            .help = "comma separated globs. declarations in files whose "
+                    "absolute path matches any of them are ignored",
+        },
+        {
+            .ids = {.id = "no-system-headers"},
+            .value = no_system_headers,
+            .help = "ignore declarations in system headers, those found "
+                    "through -isystem or the compiler's default include paths",
+        },
+        {
+            .ids = {.id = "max-include-depth"},
+            .value = max_include_depth,
+            .help = "ignore declarations in headers which are more than this "
+                    "many #includes away from the source file. 0 only keeps "
+                    "the source file itself",
+        },
+        {
+            .ids = {.id = "unity-batch"},
+            .value = unity_batch,
+            .help = "parse up to this many translation units with identical "
+                    "flags at once, by #including them all from one "
+                    "generated source. much less time is spent on shared "
+                    "headers, but macros and static declarations leak from "
+                    "one translation unit into the next, and they are not "
+                    "cached. off if 1",
+        },
     };
 
     try {
@@ -55,64 +249,163 @@ int main(int argc, const char* argv[])
         return EXIT_FAILURE;
     }
 
-    if (!output_file_path.has_value()) {
-        std::ignore = fprintf(stderr, "Provide an output _file\n");
+    cn::BuilderOptions builder_options{};
+
+    if (engine == "visitor") {
+        builder_options.engine = cn::ExtractionEngine::Visitor;
+    } else if (engine == "indexer") {
+        builder_options.engine = cn::ExtractionEngine::Indexer;
+    } else {
+        std::ignore =
+            fprintf(stderr, "Unknown engine %s, expected visitor or indexer\n",
+                    engine.c_str());
         return EXIT_FAILURE;
     }
 
-    std::ofstream output_file(output_file_path.value());
+    if (depth == "decls") {
+        builder_options.depth = cn::ParseDepth::Declarations;
+    } else if (depth == "signatures") {
+        builder_options.depth = cn::ParseDepth::Signatures;
+    } else if (depth == "bodies") {
+        builder_options.depth = cn::ParseDepth::Bodies;
+    } else {
+        std::ignore = fprintf(
+            stderr, "Unknown depth %s, expected decls, signatures or bodies\n",
+            depth.c_str());
+        return EXIT_FAILURE;
+    }
 
-    if (!output_file) {
-        std::ignore =
-            fprintf(stderr, "Unable to open output file %s for writing.\n",
-                    output_file_path.value().c_str());
+    const auto compression = cn::compression_from_name(compress);
+    if (!compression.has_value()) {
+        std::ignore = fprintf(
+            stderr, "Unknown compression %s, expected none, zstd or gzip\n",
+            compress.c_str());
+        return EXIT_FAILURE;
+    }
+    if (compress_level.has_value() &&
+        compression == cn::Compression::None) {
+        std::ignore = fprintf(
+            stderr, "A compression level needs --compress zstd or gzip\n");
+        return EXIT_FAILURE;
+    }
+    if (compress_level.has_value() &&
+        !cn::is_valid_compression_level(compression.value(),
+                                        compress_level.value())) {
+        std::ignore = fprintf(stderr, "Compression level %d is out of range\n",
+                              compress_level.value());
+        return EXIT_FAILURE;
+    }
+
+    if (!output_file_path.has_value() && !binary_output_path.has_value()) {
+        std::ignore = fprintf(stderr, "Provide an output _file\n");
         return EXIT_FAILURE;
     }
 
+    std::ofstream output_file;
+    std::ofstream binary_output_file;
+    // writes to output_file, so it has to be destroyed first
+    std::optional<cn::CompressingStream> compressed_output;
+    cn::GraphOutputs outputs{};
+    if (output_file_path.has_value()) {
+        output_file.open(output_file_path.value(), std::ios::binary);
+        if (!output_file) {
+            std::ignore =
+                fprintf(stderr, "Unable to open output file %s for writing.\n",
+                        output_file_path.value().c_str());
+            return EXIT_FAILURE;
+        }
+        outputs.graphml = &output_file;
+        if (compression != cn::Compression::None) {
+            compressed_output.emplace(output_file, compression.value(),
+                                      compress_level);
+            outputs.graphml = &compressed_output.value();
+        }
+    }
+    if (binary_output_path.has_value()) {
+        binary_output_file.open(binary_output_path.value(), std::ios::binary);
+        if (!binary_output_file) {
+            std::ignore =
+                fprintf(stderr, "Unable to open output file %s for writing.\n",
+                        binary_output_path.value().c_str());
+            return EXIT_FAILURE;
+        }
+        outputs.binary = &binary_output_file;
+    }
+
     const std::string_view cc_path =
         compile_commands_path
             .transform([](auto& str) { return std::string_view{str}; })
             .value_or("compile_commands.json");
 
-    auto maybe_ccs = cn::parse_compile_commands_json_file(cc_path);
-    if (!maybe_ccs) {
-        maybe_ccs =
-            cn::parse_compile_commands_json_file_separated_args(cc_path);
-    }
-    if (!maybe_ccs) {
-        return 1;
+    if (num_jobs == 0) {
+        num_jobs = std::max(1U, std::thread::hardware_concurrency());
     }
-    auto& ccs = maybe_ccs.value();
 
     // all memory is leaked, we do not free anything throughout the whole
     // program, though we can free it all at the end of this function
     std::pmr::monotonic_buffer_resource memory_resource{};
 
-    cn::ClangToGraphMLBuilder graph_builder(memory_resource);
-
-    for (const auto& entry : ccs) {
+    builder_options.num_jobs = num_jobs;
+    builder_options.cache_directory = cache_directory.value_or("");
+    builder_options.include_paths = split_globs(include_paths.value_or(""));
+    builder_options.exclude_paths = split_globs(exclude_paths.value_or(""));
+    builder_options.no_system_headers = no_system_headers;
+    builder_options.max_include_depth = max_include_depth;
+    builder_options.unity_batch = unity_batch;
+    cn::ClangToGraphMLBuilder graph_builder(memory_resource, builder_options);
 
-        const auto split_on_spaces = std::views::split(' ');
-
-        const auto to_string_view =
-            std::views::transform([](auto a) { return std::string_view{a}; });
+    // the compressed stream only ends its frame once closed
+    auto finish = [&graph_builder, &outputs, &compressed_output] {
+        bool finished = graph_builder.finish(outputs);
+        if (compressed_output.has_value()) {
+            finished = compressed_output->close() && finished;
+        }
+        return finished ? EXIT_SUCCESS : EXIT_FAILURE;
+    };
 
-        const auto remove_empty_strings =
-            std::views::filter([](auto sv) { return !sv.empty(); });
+    cn::CompileArgsTable args_table;
 
-        auto view = entry.command | split_on_spaces | to_string_view |
-                    remove_empty_strings | std::views::common;
+    if (!pch_directory.has_value()) {
+        // hand each entry over as soon as it is parsed, so that the workers
+        // are already busy while the rest of the file is read
+        const bool read = cn::for_each_compile_command(
+            cc_path, [&](const cn::CompileCommandEntry& entry) {
+                const cn::CompileCommand command = args_table.add(entry);
+                graph_builder.parse(command.file.c_str(), command.args);
+            });
+        if (!read) {
+            return EXIT_FAILURE;
+        }
+        return finish();
+    }
 
-        std::vector<std::string> args_storage = {view.begin(), view.end()};
+    // precompiled headers depend on which translation units share flags, so
+    // every entry has to be read before parsing starts
+    std::vector<cn::CompileCommand> commands;
+    const bool read = cn::for_each_compile_command(
+        cc_path, [&](const cn::CompileCommandEntry& entry) {
+            commands.push_back(args_table.add(entry));
+        });
+    if (!read) {
+        return EXIT_FAILURE;
+    }
 
-        auto to_ptr = args_storage | std::views::transform(&std::string::c_str);
+    const auto pchs = cn::PrecompiledHeaders::build(
+        commands, pch_directory.value(), num_jobs);
 
-        // clang wants null term strings, no sviews, so we have to copy out of
-        // the single `command` string to make them all null terminated
-        std::vector<const char*> args(to_ptr.begin(), to_ptr.end());
+    std::vector<const char*> args;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const char* pch = pchs.path_for(i);
+        if (pch == nullptr) {
+            graph_builder.parse(commands[i].file.c_str(), commands[i].args);
+            continue;
+        }
 
-        graph_builder.parse(entry.file.c_str(), args);
+        args.assign(commands[i].args.begin(), commands[i].args.end());
+        args.push_back("-include-pch");
+        args.push_back(pch);
+        graph_builder.parse(commands[i].file.c_str(), args);
     }
 
-    return graph_builder.finish(output_file) ? EXIT_SUCCESS : EXIT_FAILURE;
+    return finish();
 }
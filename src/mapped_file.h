@@ -0,0 +1,81 @@
+#ifndef __CODENODES_MAPPED_FILE_H__
+#define __CODENODES_MAPPED_FILE_H__
+
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+
+namespace cn {
+
+/// Read only mapping of a whole file
+class MappedFile
+{
+  public:
+    /// advice is passed on to madvise, for how the mapping will be read
+    static std::optional<MappedFile> open(const std::string& path,
+                                          int advice = MADV_NORMAL)
+    {
+        const int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0) {
+            return {};
+        }
+
+        struct stat info{};
+        if (fstat(descriptor, &info) != 0) {
+            ::close(descriptor);
+            return {};
+        }
+
+        MappedFile out;
+        out.m_size = static_cast<size_t>(info.st_size);
+        if (out.m_size != 0) {
+            void* mapping = mmap(nullptr, out.m_size, PROT_READ, MAP_PRIVATE,
+                                 descriptor, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(descriptor);
+                return {};
+            }
+            std::ignore = madvise(mapping, out.m_size, advice);
+            out.m_data = static_cast<const char*>(mapping);
+        }
+        // the mapping keeps the file alive
+        ::close(descriptor);
+        return out;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept
+        : m_data(std::exchange(other.m_data, nullptr)),
+          m_size(std::exchange(other.m_size, 0))
+    {
+    }
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    ~MappedFile()
+    {
+        if (m_data != nullptr) {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+    }
+
+    /// Page aligned, so anything stored at a suitably aligned offset can be
+    /// used in place
+    [[nodiscard]] std::string_view view() const { return {m_data, m_size}; }
+
+  private:
+    MappedFile() = default;
+
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+} // namespace cn
+
+#endif
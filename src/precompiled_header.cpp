@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <clang-c/Index.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <thread>
+
+#include "clang_wrapper.h"
+#include "precompiled_header.h"
+
+namespace cn {
+
+namespace {
+struct FlagSet
+{
+    std::span<const char* const> flags;
+    std::vector<size_t> commands;
+    // quoted includes are looked up relative to the including file, so they
+    // can only be shared if every translation unit is in the same directory
+    std::filesystem::path source_directory;
+    bool all_in_same_directory = true;
+    std::vector<std::string> common_includes;
+};
+
+constexpr std::string_view trim(std::string_view str)
+{
+    constexpr std::string_view whitespace = " \t\r\n";
+    const size_t begin = str.find_first_not_of(whitespace);
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    return str.substr(begin, str.find_last_not_of(whitespace) - begin + 1);
+}
+
+/// The targets of the #include directives a source file starts with, like
+/// `<vector>` or `"foo.h"`. Stops at the first line which is not an include,
+/// blank, or a comment
+std::vector<std::string>
+read_leading_includes(const std::filesystem::path& path)
+{
+    std::vector<std::string> includes;
+    std::ifstream file(path);
+    std::string line;
+    bool in_block_comment = false;
+
+    while (std::getline(file, line)) {
+        std::string_view rest = trim(line);
+
+        if (in_block_comment || rest.starts_with("/*")) {
+            const size_t end = rest.find("*/", in_block_comment ? 0 : 2);
+            in_block_comment = end == std::string_view::npos;
+            if (in_block_comment) {
+                continue;
+            }
+            rest = trim(rest.substr(end + 2));
+        }
+
+        if (rest.empty() || rest.starts_with("//")) {
+            continue;
+        }
+
+        if (!rest.starts_with('#')) {
+            break;
+        }
+        rest = trim(rest.substr(1));
+        if (!rest.starts_with("include")) {
+            // a #define or #if could change what the includes mean
+            break;
+        }
+        rest = trim(rest.substr(std::string_view("include").size()));
+
+        char close = '\0';
+        if (rest.starts_with('<')) {
+            close = '>';
+        } else if (rest.starts_with('"')) {
+            close = '"';
+        } else {
+            // computed include
+            break;
+        }
+
+        const size_t end = rest.find(close, 1);
+        if (end == std::string_view::npos) {
+            break;
+        }
+        includes.emplace_back(rest.substr(0, end + 1));
+    }
+
+    return includes;
+}
+
+bool has_errors(CXTranslationUnit unit)
+{
+    const unsigned num_diagnostics = clang_getNumDiagnostics(unit);
+    for (unsigned i = 0; i < num_diagnostics; ++i) {
+        CXDiagnostic diagnostic = clang_getDiagnostic(unit, i);
+        const auto severity = clang_getDiagnosticSeverity(diagnostic);
+        clang_disposeDiagnostic(diagnostic);
+        if (severity >= CXDiagnostic_Error) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool build_precompiled_header(const FlagSet& flag_set,
+                              const std::string& pch_path)
+{
+    std::string contents;
+    for (const auto& include : flag_set.common_includes) {
+        contents.append("#include ");
+        contents.append(include);
+        contents.push_back('\n');
+    }
+
+    // the header only exists in memory, but it is placed next to the sources
+    // so that quoted includes resolve the same way they do for them
+    const std::string header_path =
+        (flag_set.source_directory /
+         std::filesystem::path(pch_path).stem().concat(".h"))
+            .string();
+
+    CXUnsavedFile unsaved{
+        .Filename = header_path.c_str(),
+        .Contents = contents.c_str(),
+        .Length = contents.size(),
+    };
+
+    std::vector<const char*> args;
+    args.reserve(flag_set.flags.size() + 2);
+    args.assign(flag_set.flags.begin(), flag_set.flags.end());
+    args.push_back("-x");
+    args.push_back("c++-header");
+
+    CXIndex index = clang_createIndex(0, 0);
+    CXTranslationUnit unit{};
+    const CXErrorCode error = clang_parseTranslationUnit2FullArgv(
+        index, header_path.c_str(), args.data(), static_cast<int>(args.size()),
+        &unsaved, 1,
+        CXTranslationUnit_ForSerialization | CXTranslationUnit_Incomplete,
+        &unit);
+
+    const bool succeeded =
+        error == CXError_Success && !has_errors(unit) &&
+        clang_saveTranslationUnit(unit, pch_path.c_str(),
+                                  clang_defaultSaveOptions(unit)) ==
+            CXSaveError_None;
+
+    if (!succeeded) {
+        std::ignore = fprintf(stderr,
+                              "WARNING: unable to build precompiled header %s "
+                              "for %zu translation units, they will be parsed "
+                              "without one\n",
+                              pch_path.c_str(), flag_set.commands.size());
+    }
+
+    clang_disposeTranslationUnit(unit);
+    clang_disposeIndex(index);
+    return succeeded;
+}
+} // namespace
+
+PrecompiledHeaders
+PrecompiledHeaders::build(std::span<const CompileCommand> commands,
+                          std::string_view directory, size_t num_jobs) noexcept
+{
+    PrecompiledHeaders out;
+    out.m_path_index_by_command.resize(commands.size(), -1);
+
+    std::map<std::string, FlagSet> flag_sets;
+
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const CompileCommand& command = commands[i];
+
+        // paths in the flags are absolute, so the flags alone decide how the
+        // headers are parsed. the key is also what names the PCH file, so it
+        // has to be the same from run to run
+        std::string key;
+        for (const char* flag : command.args) {
+            key.append(flag);
+            key.push_back('\0');
+        }
+
+        const std::filesystem::path source_path{command.file};
+        std::vector<std::string> includes = read_leading_includes(source_path);
+
+        auto [iter, inserted] = flag_sets.try_emplace(std::move(key));
+        FlagSet& flag_set = iter->second;
+        flag_set.commands.push_back(i);
+
+        if (inserted) {
+            flag_set.flags = command.args;
+            flag_set.source_directory = source_path.parent_path();
+            flag_set.common_includes = std::move(includes);
+            continue;
+        }
+
+        flag_set.all_in_same_directory =
+            flag_set.all_in_same_directory &&
+            flag_set.source_directory == source_path.parent_path();
+
+        auto& common = flag_set.common_includes;
+        const auto mismatch = std::ranges::mismatch(common, includes);
+        common.erase(mismatch.in1, common.end());
+    }
+
+    std::vector<std::pair<const FlagSet*, std::string>> to_build;
+
+    for (auto& [key, flag_set] : flag_sets) {
+        if (!flag_set.all_in_same_directory) {
+            auto first_quoted =
+                std::ranges::find_if(flag_set.common_includes,
+                                     [](const std::string& include) {
+                                         return include.starts_with('"');
+                                     });
+            flag_set.common_includes.erase(first_quoted,
+                                           flag_set.common_includes.end());
+        }
+
+        if (flag_set.commands.size() < min_translation_units ||
+            flag_set.common_includes.empty()) {
+            continue;
+        }
+
+        std::array<char, 32> name{};
+        std::ignore = snprintf(name.data(), name.size(), "codenodes-%016zx.pch",
+                               std::hash<std::string>{}(key));
+        to_build.emplace_back(
+            &flag_set,
+            (std::filesystem::path(directory) / name.data()).string());
+    }
+
+    if (to_build.empty()) {
+        return out;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::ignore = fprintf(stderr,
+                              "Unable to create precompiled header directory "
+                              "%.*s: %s\n",
+                              static_cast<int>(directory.size()),
+                              directory.data(), error.message().c_str());
+        return out;
+    }
+
+    // building is as slow as parsing a translation unit, so spread it over the
+    // same number of threads
+    std::vector<char> succeeded(to_build.size(), 0);
+    std::atomic<size_t> next = 0;
+    const auto build_remaining = [&] {
+        for (size_t i = next++; i < to_build.size(); i = next++) {
+            succeeded[i] = static_cast<char>(build_precompiled_header(
+                *to_build[i].first, to_build[i].second));
+        }
+    };
+
+    {
+        std::vector<std::jthread> threads;
+        const size_t num_threads =
+            std::min(std::max<size_t>(num_jobs, 1), to_build.size());
+        for (size_t i = 1; i < num_threads; ++i) {
+            threads.emplace_back(build_remaining);
+        }
+        build_remaining();
+    }
+
+    for (size_t i = 0; i < to_build.size(); ++i) {
+        if (succeeded[i] == 0) {
+            continue;
+        }
+        const auto path_index = static_cast<ptrdiff_t>(out.m_paths.size());
+        out.m_paths.push_back(std::move(to_build[i].second));
+        for (size_t command : to_build[i].first->commands) {
+            out.m_path_index_by_command[command] = path_index;
+        }
+    }
+
+    return out;
+}
+
+const char* PrecompiledHeaders::path_for(size_t command_index) const noexcept
+{
+    if (command_index >= m_path_index_by_command.size() ||
+        m_path_index_by_command[command_index] < 0) {
+        return nullptr;
+    }
+    return m_paths[m_path_index_by_command[command_index]].c_str();
+}
+
+} // namespace cn
@@ -0,0 +1,45 @@
+#ifndef __CODENODES_PRECOMPILED_HEADER_H__
+#define __CODENODES_PRECOMPILED_HEADER_H__
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "compile_args.h"
+
+namespace cn {
+
+/// One precompiled header per distinct set of compiler flags, containing the
+/// #includes which every translation unit with those flags starts with. Jobs
+/// then pass it as -include-pch so that those headers are parsed once rather
+/// than once per translation unit.
+class PrecompiledHeaders
+{
+  public:
+    /// A flag set needs at least this many translation units before it gets a
+    /// PCH, otherwise building it costs more than it saves
+    static constexpr size_t min_translation_units = 2;
+
+    /// PCH files are written into directory, which is created if needed. Flag
+    /// sets which fail to build a PCH just don't get one.
+    static PrecompiledHeaders build(std::span<const CompileCommand> commands,
+                                    std::string_view directory,
+                                    size_t num_jobs) noexcept;
+
+    /// Path of the PCH to use for commands[command_index], or nullptr if it
+    /// should be parsed without one
+    [[nodiscard]] const char* path_for(size_t command_index) const noexcept;
+
+    [[nodiscard]] size_t size() const noexcept { return m_paths.size(); }
+
+  private:
+    // each PCH file that was successfully built
+    std::vector<std::string> m_paths;
+    // index into m_paths for each command, or -1 if it has no PCH
+    std::vector<ptrdiff_t> m_path_index_by_command;
+};
+
+} // namespace cn
+
+#endif
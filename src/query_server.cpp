@@ -0,0 +1,466 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <ranges>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+
+#include "query_server.h"
+
+namespace cn {
+
+namespace {
+uint64_t hash_name(std::string_view name)
+{
+    return std::hash<std::string_view>{}(name);
+}
+
+/// Splits off the text up to the next tab
+std::string_view next_field(std::string_view& fields)
+{
+    const size_t tab = fields.find('\t');
+    const std::string_view out = fields.substr(0, tab);
+    fields.remove_prefix(tab == std::string_view::npos ? fields.size()
+                                                        : tab + 1);
+    return out;
+}
+
+void append_decimal(std::string& out, uint64_t value)
+{
+    std::array<char, 20> digits{};
+    char* end =
+        std::to_chars(digits.data(), digits.data() + digits.size(), value).ptr;
+    out.append(digits.data(), end);
+}
+
+void append_error(std::string& out, std::string_view why)
+{
+    out.append("error\t");
+    out.append(why);
+    out.push_back('\n');
+}
+
+void append_ok(std::string& out, size_t count)
+{
+    out.append("ok\t");
+    append_decimal(out, count);
+    out.push_back('\n');
+}
+
+/// Namespaces contain everything, so a path through them says nothing about
+/// what depends on what
+bool is_dependency(EdgeKind kind) { return kind != EdgeKind::Contains; }
+
+/// Sends all of bytes, false if the client went away
+bool send_all(int client, std::string_view bytes)
+{
+    while (!bytes.empty()) {
+        const ssize_t sent =
+            ::send(client, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes.remove_prefix(static_cast<size_t>(sent));
+    }
+    return true;
+}
+
+/// Longest request line we buffer, far more than any symbol needs
+constexpr size_t max_request_size = size_t{1} << 16;
+
+/// Answers requests until the client closes the connection, or sends a line
+/// longer than max_request_size. Requests which arrive together are answered
+/// in one write
+void handle_connection(const QueryEngine& engine, int client,
+                       QueryEngine::Scratch& scratch)
+{
+    std::string pending;
+    std::string out;
+    std::array<char, size_t{1} << 16> received{};
+    while (true) {
+        const ssize_t size =
+            ::recv(client, received.data(), received.size(), 0);
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size <= 0) {
+            return;
+        }
+        pending.append(received.data(), static_cast<size_t>(size));
+
+        out.clear();
+        size_t line_begin = 0;
+        for (size_t newline = pending.find('\n');
+             newline != std::string::npos;
+             newline = pending.find('\n', line_begin)) {
+            if (newline - line_begin > max_request_size) {
+                break;
+            }
+            std::string_view line{pending.data() + line_begin,
+                                  newline - line_begin};
+            if (line.ends_with('\r')) {
+                line.remove_suffix(1);
+            }
+            engine.answer(line, scratch, out);
+            line_begin = newline + 1;
+        }
+        pending.erase(0, line_begin);
+
+        // what is left is either the start of the next line or one that was
+        // too long. Answers to the lines before it still go out, then we hang
+        // up rather than keep buffering
+        if (pending.size() > max_request_size) {
+            append_error(out, "request too long");
+            std::ignore = send_all(client, out);
+            return;
+        }
+
+        if (!send_all(client, out)) {
+            return;
+        }
+    }
+}
+
+/// Hands each connection on listener to handle_connection, forever
+[[noreturn]] void accept_connections(const QueryEngine& engine, int listener)
+{
+    QueryEngine::Scratch scratch;
+    while (true) {
+        const int client =
+            ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            // out of descriptors, say, which clears up as other connections
+            // close
+            if (errno != EINTR && errno != ECONNABORTED) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            continue;
+        }
+        handle_connection(engine, client, scratch);
+        ::close(client);
+    }
+}
+} // namespace
+
+QueryEngine::QueryEngine(const GraphView& graph) : m_graph(graph)
+{
+    std::string name;
+    m_names.reserve(graph.num_nodes());
+    for (NodeId node = 0; node < graph.num_nodes(); ++node) {
+        name.clear();
+        graph.append_qualified_name(node, name);
+        m_names.emplace_back(hash_name(name), node);
+    }
+    std::ranges::sort(m_names);
+}
+
+void QueryEngine::resolve(std::string_view symbol, Scratch& scratch) const
+{
+    scratch.matches.clear();
+
+    // names can't start with #, so a node id is never mistaken for one
+    if (symbol.size() > 1 && symbol.front() == '#') {
+        NodeId node = no_node;
+        const char* end = symbol.data() + symbol.size();
+        const auto parsed = std::from_chars(symbol.data() + 1, end, node);
+        if (parsed.ec == std::errc{} && parsed.ptr == end) {
+            if (node < m_graph.num_nodes()) {
+                scratch.matches.push_back(node);
+            }
+            return;
+        }
+    }
+
+    if (symbol.starts_with("c:")) {
+        if (const NodeId node = m_graph.find_usr(symbol); node != no_node) {
+            scratch.matches.push_back(node);
+        }
+        return;
+    }
+
+    // overloads and redeclared namespaces share a name, and different names
+    // can share a hash
+    const auto [begin, end] = std::ranges::equal_range(
+        m_names, hash_name(symbol), {}, &std::pair<uint64_t, NodeId>::first);
+    for (const auto& [hash, node] : std::ranges::subrange(begin, end)) {
+        scratch.name.clear();
+        m_graph.append_qualified_name(node, scratch.name);
+        if (scratch.name == symbol) {
+            scratch.matches.push_back(node);
+        }
+    }
+}
+
+NodeId QueryEngine::resolve_one(std::string_view symbol, Scratch& scratch,
+                                std::string& out) const
+{
+    resolve(symbol, scratch);
+    if (scratch.matches.size() == 1) {
+        return scratch.matches.front();
+    }
+
+    std::string why{scratch.matches.empty() ? "no symbol " : "ambiguous "};
+    why.append(symbol);
+    if (!scratch.matches.empty()) {
+        why.append(", use lookup for its node ids");
+    }
+    append_error(out, why);
+    return no_node;
+}
+
+void QueryEngine::find_path(NodeId from, NodeId to, Scratch& scratch) const
+{
+    scratch.path.clear();
+    if (from == to) {
+        scratch.path.emplace_back(from, EdgeKind::Contains);
+        return;
+    }
+
+    const size_t num_nodes = m_graph.num_nodes();
+    if (scratch.forward_seen.size() != num_nodes || ++scratch.generation == 0) {
+        scratch.forward_seen.assign(num_nodes, 0);
+        scratch.backward_seen.assign(num_nodes, 0);
+        scratch.forward_parents.resize(num_nodes);
+        scratch.backward_parents.resize(num_nodes);
+        scratch.forward_kinds.resize(num_nodes);
+        scratch.backward_kinds.resize(num_nodes);
+        scratch.generation = 1;
+    }
+    const uint32_t generation = scratch.generation;
+
+    // breadth first from both ends at once, always growing the smaller
+    // frontier, so that only around the square root of what a one sided
+    // search would visit gets visited
+    scratch.forward_seen[from] = generation;
+    scratch.backward_seen[to] = generation;
+    scratch.forward_frontier.assign(1, from);
+    scratch.backward_frontier.assign(1, to);
+    NodeId meeting = no_node;
+    while (meeting == no_node && !scratch.forward_frontier.empty() &&
+           !scratch.backward_frontier.empty()) {
+        const bool forward = scratch.forward_frontier.size() <=
+                             scratch.backward_frontier.size();
+        auto& frontier =
+            forward ? scratch.forward_frontier : scratch.backward_frontier;
+        auto& seen = forward ? scratch.forward_seen : scratch.backward_seen;
+        auto& parents =
+            forward ? scratch.forward_parents : scratch.backward_parents;
+        auto& kinds = forward ? scratch.forward_kinds : scratch.backward_kinds;
+        const auto& other_seen =
+            forward ? scratch.backward_seen : scratch.forward_seen;
+
+        scratch.next_frontier.clear();
+        for (const NodeId node : frontier) {
+            const auto neighbours =
+                forward ? m_graph.targets(node) : m_graph.sources(node);
+            const auto neighbour_kinds = forward ? m_graph.target_kinds(node)
+                                                 : m_graph.source_kinds(node);
+            for (size_t i = 0; i < neighbours.size(); ++i) {
+                const NodeId neighbour = neighbours[i];
+                if (!is_dependency(neighbour_kinds[i]) ||
+                    seen[neighbour] == generation) {
+                    continue;
+                }
+                seen[neighbour] = generation;
+                parents[neighbour] = node;
+                kinds[neighbour] = neighbour_kinds[i];
+                if (other_seen[neighbour] == generation) {
+                    meeting = neighbour;
+                    break;
+                }
+                scratch.next_frontier.push_back(neighbour);
+            }
+            if (meeting != no_node) {
+                break;
+            }
+        }
+        frontier.swap(scratch.next_frontier);
+    }
+    if (meeting == no_node) {
+        return;
+    }
+
+    // back from the meeting point to from, each node with the edge into it
+    for (NodeId node = meeting; node != from;
+         node = scratch.forward_parents[node]) {
+        scratch.path.emplace_back(node, scratch.forward_kinds[node]);
+    }
+    scratch.path.emplace_back(from, EdgeKind::Contains);
+    std::ranges::reverse(scratch.path);
+    // then on to to, where each node's edge leads to the one after it
+    for (NodeId node = meeting; node != to;
+         node = scratch.backward_parents[node]) {
+        scratch.path.emplace_back(scratch.backward_parents[node],
+                                  scratch.backward_kinds[node]);
+    }
+}
+
+uint32_t QueryEngine::edge_weight(NodeId source, NodeId target,
+                                  EdgeKind kind) const
+{
+    const auto targets = m_graph.targets(source);
+    const auto kinds = m_graph.target_kinds(source);
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (targets[i] == target && kinds[i] == kind) {
+            return m_graph.target_weights(source)[i];
+        }
+    }
+    return 0;
+}
+
+void QueryEngine::append_node(NodeId node, std::string_view edge_kind,
+                              uint32_t weight, Scratch& scratch,
+                              std::string& out) const
+{
+    out.push_back('#');
+    append_decimal(out, node);
+    out.push_back('\t');
+    out.append(symbol_kind_name(m_graph.kinds[node]));
+    out.push_back('\t');
+    out.append(edge_kind);
+    out.push_back('\t');
+    if (weight == 0) {
+        out.push_back('-');
+    } else {
+        append_decimal(out, weight);
+    }
+    out.push_back('\t');
+    out.append(m_graph.usr(node));
+    out.push_back('\t');
+    scratch.name.clear();
+    m_graph.append_qualified_name(node, scratch.name);
+    out.append(scratch.name);
+    out.push_back('\n');
+}
+
+void QueryEngine::answer(std::string_view request, Scratch& scratch,
+                         std::string& out) const
+{
+    const std::string_view command = next_field(request);
+
+    if (command == "lookup") {
+        resolve(next_field(request), scratch);
+        append_ok(out, scratch.matches.size());
+        for (const NodeId node : scratch.matches) {
+            append_node(node, "-", 0, scratch, out);
+        }
+        return;
+    }
+
+    if (command == "dependents" || command == "dependencies" ||
+        command == "children") {
+        const NodeId node = resolve_one(next_field(request), scratch, out);
+        if (node == no_node) {
+            return;
+        }
+        const bool dependents = command == "dependents";
+        const auto nodes =
+            dependents ? m_graph.sources(node) : m_graph.targets(node);
+        const auto kinds = dependents ? m_graph.source_kinds(node)
+                                      : m_graph.target_kinds(node);
+        const auto weights = dependents ? m_graph.source_weights(node)
+                                        : m_graph.target_weights(node);
+        const auto wanted = [&command](EdgeKind kind) {
+            return command != "children" || kind == EdgeKind::Contains ||
+                   kind == EdgeKind::Member;
+        };
+        append_ok(out,
+                  static_cast<size_t>(std::ranges::count_if(kinds, wanted)));
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (wanted(kinds[i])) {
+                append_node(nodes[i], edge_kind_name(kinds[i]), weights[i],
+                            scratch, out);
+            }
+        }
+        return;
+    }
+
+    if (command == "path") {
+        const NodeId from = resolve_one(next_field(request), scratch, out);
+        if (from == no_node) {
+            return;
+        }
+        const NodeId to = resolve_one(next_field(request), scratch, out);
+        if (to == no_node) {
+            return;
+        }
+        find_path(from, to, scratch);
+        append_ok(out, scratch.path.size());
+        for (size_t i = 0; i < scratch.path.size(); ++i) {
+            const auto [node, kind] = scratch.path[i];
+            if (i == 0) {
+                append_node(node, "-", 0, scratch, out);
+                continue;
+            }
+            // every edge on the path leads from the node before
+            const uint32_t weight =
+                edge_weight(scratch.path[i - 1].first, node, kind);
+            append_node(node, edge_kind_name(kind), weight, scratch, out);
+        }
+        return;
+    }
+
+    std::string why{"unknown command "};
+    why.append(command);
+    append_error(out, why);
+}
+
+void serve_graph(const GraphView& graph, const std::string& socket_path,
+                 size_t num_threads) noexcept
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::ignore = fprintf(stderr, "Socket path %s is too long\n",
+                              socket_path.c_str());
+        return;
+    }
+    std::ranges::copy(socket_path, address.sun_path);
+
+    // a server which went away leaves its socket behind, but anything else
+    // at that path is left alone and makes bind fail
+    struct stat existing{};
+    if (lstat(socket_path.c_str(), &existing) == 0 &&
+        S_ISSOCK(existing.st_mode)) {
+        ::unlink(socket_path.c_str());
+    }
+
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 ||
+        ::bind(listener, reinterpret_cast<const sockaddr*>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(listener, SOMAXCONN) != 0) {
+        std::ignore = fprintf(stderr, "Unable to listen on %s: %s\n",
+                              socket_path.c_str(), std::strerror(errno));
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        return;
+    }
+
+    const QueryEngine engine(graph);
+    std::ignore = fprintf(stderr, "Serving %zu nodes on %s\n",
+                          graph.num_nodes(), socket_path.c_str());
+
+    // every thread blocks in accept, and the kernel hands each connection to
+    // one of them. This one is among them, and as none ever stop, the engine
+    // on its stack outlives them all
+    for (size_t i = 1; i < num_threads; ++i) {
+        std::thread(accept_connections, std::cref(engine), listener).detach();
+    }
+    accept_connections(engine, listener);
+}
+
+} // namespace cn
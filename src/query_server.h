@@ -0,0 +1,103 @@
+#ifndef __CODENODES_QUERY_SERVER_H__
+#define __CODENODES_QUERY_SERVER_H__
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+namespace cn {
+
+/// Answers queries about a graph, one request line at a time. Requests are
+/// tab separated, a command followed by its symbols:
+///
+///     lookup        <symbol>          every node the symbol names
+///     dependents    <symbol>          nodes with an edge to it
+///     dependencies  <symbol>          nodes it has an edge to
+///     children      <symbol>          its members or namespace contents
+///     path          <from> <to>       shortest chain of edges between two
+///                                     nodes, not counting namespace contents
+///
+/// A symbol is # followed by a node id, a USR, which starts with c:, or a
+/// qualified name like outer::inner::name. Anything but lookup wants exactly
+/// one node. The answer is `ok <count>`, then that many lines of node id,
+/// symbol kind, edge kind, edge weight, USR and qualified name, or
+/// `error <why>`. Fields are tab separated and every line ends in a newline.
+/// The edge is the one to the dependent, dependency, child, or the previous
+/// node on the path, and both its fields are - where there is none. The
+/// weight is how many times the edge occurs, like the number of call sites
+class QueryEngine
+{
+  public:
+    /// Working memory for one thread's queries, reused between them
+    class Scratch
+    {
+      private:
+        friend class QueryEngine;
+
+        // a node was seen by this search if its entry is generation
+        uint32_t generation = 0;
+        std::vector<uint32_t> forward_seen;
+        std::vector<uint32_t> backward_seen;
+        // how each seen node was reached
+        std::vector<NodeId> forward_parents;
+        std::vector<NodeId> backward_parents;
+        std::vector<EdgeKind> forward_kinds;
+        std::vector<EdgeKind> backward_kinds;
+        std::vector<NodeId> forward_frontier;
+        std::vector<NodeId> backward_frontier;
+        std::vector<NodeId> next_frontier;
+
+        std::vector<NodeId> matches;
+        std::vector<std::pair<NodeId, EdgeKind>> path;
+        std::string name;
+    };
+
+    /// Indexes every qualified name, which takes a pass over the graph. The
+    /// graph must outlive this
+    explicit QueryEngine(const GraphView& graph);
+
+    /// Appends the answer to request, which is a single line without its
+    /// newline, to out
+    void answer(std::string_view request, Scratch& scratch,
+                std::string& out) const;
+
+  private:
+    /// Fills scratch.matches with the nodes symbol names
+    void resolve(std::string_view symbol, Scratch& scratch) const;
+
+    /// Like resolve, but writes an error and returns no_node unless there is
+    /// exactly one
+    NodeId resolve_one(std::string_view symbol, Scratch& scratch,
+                       std::string& out) const;
+
+    /// Fills scratch.path, empty if there is none
+    void find_path(NodeId from, NodeId to, Scratch& scratch) const;
+
+    /// Weight of the edge, 0 if there is none
+    [[nodiscard]] uint32_t edge_weight(NodeId source, NodeId target,
+                                       EdgeKind kind) const;
+
+    /// weight is 0 where there is no edge
+    void append_node(NodeId node, std::string_view edge_kind, uint32_t weight,
+                     Scratch& scratch, std::string& out) const;
+
+    const GraphView& m_graph;
+    // hash of every node's qualified name, sorted
+    std::vector<std::pair<uint64_t, NodeId>> m_names;
+};
+
+/// Answers queries against the graph on a Unix domain socket at socket_path,
+/// replacing any socket already there. Each of num_threads, the calling one
+/// included, takes one connection at a time, and answers every request sent
+/// on it in order. Only returns, after printing why, if the socket could not
+/// be set up
+void serve_graph(const GraphView& graph, const std::string& socket_path,
+                 size_t num_threads) noexcept;
+
+} // namespace cn
+
+#endif
@@ -1,11 +1,16 @@
 #ifndef __SYMBOL_H__
 #define __SYMBOL_H__
 
+#include <atomic>
 #include <clang-c/Index.h>
+#include <memory_resource>
+#include <vector>
 
 #include "aliases.h"
 #include "clang_to_graphml.h"
+#include "graph.h"
 #include "type_identifier.h"
+#include "usr_interner.h"
 
 namespace cn {
 
@@ -14,22 +19,24 @@ struct EnumTypeSymbol;
 struct ClassSymbol;
 struct NamespaceSymbol;
 
-enum class SymbolKind : uint8_t
+struct Symbol;
+
+/// An outgoing edge, see Symbol::append_references
+struct Reference
 {
-    Namespace,
-    Function,
-    Enum,
-    Aggregate, // union, class, struct
+    Symbol* target;
+    EdgeKind kind;
+    // how many times the edge occurs, like the number of call sites
+    uint32_t weight = 1;
 };
 
 struct Symbol
 {
     Symbol() = delete;
-    constexpr Symbol(Symbol* _semantic_parent, SymbolKind _kind, String&& _usr,
-                     std::optional<CXCursor> /* cursor */,
-                     String&& _display_name)
-        : semantic_parent(_semantic_parent), symbol_kind(_kind),
-          usr(std::move(_usr)), display_name(std::move(_display_name))
+    constexpr Symbol(Symbol* _semantic_parent, SymbolKind _kind, UsrId _usr,
+                     String&& _name)
+        : semantic_parent(_semantic_parent), symbol_kind(_kind), usr(_usr),
+          name(std::move(_name))
     {
     }
 
@@ -39,24 +46,36 @@ struct Symbol
     Symbol& operator=(Symbol&&) noexcept = default;
     virtual ~Symbol() = default;
 
-    [[nodiscard]] virtual size_t get_num_symbols_this_references() const = 0;
-    [[nodiscard]] virtual const Symbol*
-    get_symbol_this_references(size_t index) const = 0;
-    [[nodiscard]] virtual Symbol* get_symbol_this_references(size_t index) = 0;
-
-    constexpr void try_visit_children(ClangToGraphMLBuilder::Job& job,
-                                      const CXCursor& cursor)
+    void try_visit_children(ClangToGraphMLBuilder::Job& job,
+                            const CXCursor& cursor)
     {
-        if (!this->visited) {
-            // prevent recursive visiting, technically we have not been visited
-            // yet but should be fine, usually if recursion was going to happen
-            // it's because we weren't a forward declaration anyways
-            this->visited = true;
+        // a job which can't fill us in must not claim us, or a job on another
+        // thread which has the definition would skip us in the meantime
+        if (!this->has_children(cursor)) {
+            return;
+        }
+        // this is how a job claims the symbol, so only one job ever writes to
+        // a symbol's children. it also stops recursive visiting
+        if (!this->visited.exchange(true, std::memory_order_acq_rel)) {
             bool actually_visited = this->visit_children_impl(job, cursor);
-            this->visited = actually_visited;
+            this->visited.store(actually_visited, std::memory_order_release);
         }
     }
 
+    /// Every symbol this one refers to, in the order they should be output.
+    /// The same target may come up more than once, like a type used by
+    /// several fields, and is collapsed into one weighted edge when the graph
+    /// is built. Only meaningful once parsing is done
+    virtual void append_references(std::pmr::vector<Reference>& out) const = 0;
+
+    /// Appends the name qualified by every semantic parent, like
+    /// outer::inner::name. Symbols only store their own name, so this is
+    /// worked out again every time it is needed
+    void append_qualified_name(std::string& out) const
+    {
+        append_qualified_name(out, out.size());
+    }
+
     template <typename T> T* upcast() &
     {
         if constexpr (std::same_as<T, FunctionSymbol>) {
@@ -80,7 +99,28 @@ struct Symbol
         }
     }
 
+  private:
+    // parents with an empty name, like anonymous namespaces, still get a
+    // separator, but nothing goes before the outermost name
+    void append_qualified_name(std::string& out, size_t start) const
+    {
+        if (semantic_parent != nullptr) {
+            semantic_parent->append_qualified_name(out, start);
+            if (out.size() != start) {
+                out.append("::");
+            }
+        }
+        out.append(name);
+    }
+
   protected:
+    /// Whether visit_children_impl can fill the symbol in from cursor, false
+    /// for a declaration whose definition this translation unit lacks
+    [[nodiscard]] virtual bool has_children(const CXCursor& /*cursor*/) const
+    {
+        return true;
+    }
+
     /// Return true if succeeded, ie. this isn't a forward decl
     [[nodiscard]] virtual bool
     visit_children_impl(ClangToGraphMLBuilder::Job& job,
@@ -88,11 +128,17 @@ struct Symbol
 
   public:
     SymbolKind symbol_kind;
-    String usr;
-    String display_name;
+    // look it up in PersistentData::usrs
+    UsrId usr;
+    // spelling of just this symbol, see append_qualified_name
+    String name;
     Symbol* semantic_parent;
-    bool visited = false;    // if this is a forward declaration it may not be
-    bool serialized = false; // avoid recursion during serialization
+    // if this is a forward declaration it may not be
+    std::atomic<bool> visited = false;
+    // some translation unit had a declaration of this in scope. Symbols which
+    // are only here because something in scope refers to them are left out
+    // of the graph, see Job::mark_in_scope
+    std::atomic<bool> in_scope = false;
 };
 
 struct NamespaceSymbol : public Symbol
@@ -100,43 +146,35 @@ struct NamespaceSymbol : public Symbol
     constexpr static auto kind = SymbolKind::Namespace;
 
     constexpr NamespaceSymbol(std::pmr::polymorphic_allocator<> allocator,
-                              Symbol* _semantic_parent, String&& _name,
-                              std::optional<CXCursor> cursor,
-                              String&& _displayName)
-        : Symbol(_semantic_parent, kind, std::move(_name), cursor,
-                 std::move(_displayName)),
+                              Symbol* _semantic_parent, UsrId _usr,
+                              std::optional<CXCursor> /* cursor */,
+                              String&& _name)
+        : Symbol(_semantic_parent, kind, _usr, std::move(_name)),
           symbols(allocator)
     {
     }
 
-    [[nodiscard]] size_t get_num_symbols_this_references() const final
-    {
-        return symbols.size();
-    }
+    /// Namespaces can be reopened any number of times in any translation unit,
+    /// so unlike other symbols they are never marked as visited. Instead every
+    /// namespace block is walked once per job. cursor must be of type
+    /// CXCursor_Namespace
+    void visit_block(ClangToGraphMLBuilder::Job& job, const CXCursor& cursor);
 
-    [[nodiscard]] const Symbol*
-    get_symbol_this_references(size_t index) const final
-    {
-        if (index >= symbols.size()) {
-            return nullptr;
-        }
-        return symbols.at(index);
-    }
+  protected:
+    // always returns false, see visit_block
+    [[nodiscard]] bool visit_children_impl(ClangToGraphMLBuilder::Job& job,
+                                           const CXCursor& cursor) final;
 
-    [[nodiscard]] Symbol* get_symbol_this_references(size_t index) final
+    void append_references(std::pmr::vector<Reference>& out) const final
     {
-        if (index >= symbols.size()) {
-            return nullptr;
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            out.push_back({symbols.at(i), EdgeKind::Contains});
         }
-        return symbols.at(index);
     }
 
-  protected:
-    // cursor must be of type CXCursor_Namespace
-    [[nodiscard]] bool visit_children_impl(ClangToGraphMLBuilder::Job& job,
-                                           const CXCursor& cursor) final;
-
   public:
+    // filled in by ClangToGraphMLBuilder::finish, from the semantic parents of
+    // all other symbols, so that it does not depend on which job saw what first
     OrderedCollection<Symbol*> symbols;
 };
 
@@ -144,15 +182,21 @@ struct ClassSymbol : public Symbol
 {
     constexpr static auto kind = SymbolKind::Aggregate;
 
+    enum class AggregateKind : uint8_t
+    {
+        Class,
+        Struct,
+        Union,
+    };
+
     // cursor for class symbol is not optional, that way passing
     // semantic_parent, name, cursor is always valid constructor args in
     // template like allocator->new_object(), but we can still handle the
     // case with the root namespace where it has no parent cursor
     constexpr ClassSymbol(std::pmr::polymorphic_allocator<> allocator,
-                          Symbol* _semantic_parent, String&& _name,
-                          CXCursor cursor, String&& _displayName)
-        : Symbol(_semantic_parent, kind, std::move(_name), cursor,
-                 std::move(_displayName)),
+                          Symbol* _semantic_parent, UsrId _usr,
+                          CXCursor cursor, String&& _name)
+        : Symbol(_semantic_parent, kind, _usr, std::move(_name)),
           aggregate_kind(get_aggregate_kind_of_cursor(cursor)),
           type_refs(allocator), parent_classes(allocator),
           field_types(allocator), inner_classes(allocator),
@@ -160,14 +204,24 @@ struct ClassSymbol : public Symbol
     {
     }
 
-    enum class AggregateKind : uint8_t
+    // for symbols loaded from the fragment cache, which have no cursor
+    constexpr ClassSymbol(std::pmr::polymorphic_allocator<> allocator,
+                          Symbol* _semantic_parent, UsrId _usr,
+                          AggregateKind _aggregate_kind, String&& _name)
+        : Symbol(_semantic_parent, kind, _usr, std::move(_name)),
+          aggregate_kind(_aggregate_kind), type_refs(allocator),
+          parent_classes(allocator), field_types(allocator),
+          inner_classes(allocator), member_functions(allocator),
+          inner_enums(allocator)
     {
-        Class,
-        Struct,
-        Union,
-    };
+    }
 
   protected:
+    [[nodiscard]] bool has_children(const CXCursor& cursor) const final
+    {
+        return clang_Cursor_isNull(clang_getCursorDefinition(cursor)) == 0;
+    }
+
     // cursor must be of type CXCursor_ClassDecl or CXCursor_UnionDecl or
     // CXCursor_StructDecl
     [[nodiscard]] bool visit_children_impl(ClangToGraphMLBuilder::Job& job,
@@ -175,16 +229,14 @@ struct ClassSymbol : public Symbol
 
     AggregateKind get_aggregate_kind_of_cursor(CXCursor cursor);
 
-  public:
-    [[nodiscard]] size_t get_num_symbols_this_references() const final;
-    [[nodiscard]] Symbol* get_symbol_this_references(size_t index) final;
-    [[nodiscard]] const Symbol*
-    get_symbol_this_references(size_t index) const final;
+    void append_references(std::pmr::vector<Reference>& out) const final;
 
+  public:
     AggregateKind aggregate_kind;
-    OrderedCollection<TypeIdentifier> type_refs;
-    OrderedCollection<TypeIdentifier> parent_classes;
-    OrderedCollection<TypeIdentifier> field_types;
+    // all interned by PersistentData::types
+    OrderedCollection<const TypeIdentifier*> type_refs;
+    OrderedCollection<const TypeIdentifier*> parent_classes;
+    OrderedCollection<const TypeIdentifier*> field_types;
     OrderedCollection<ClassSymbol*> inner_classes;
     OrderedCollection<FunctionSymbol*> member_functions;
     OrderedCollection<EnumTypeSymbol*> inner_enums;
@@ -197,11 +249,10 @@ struct EnumTypeSymbol : public Symbol
     // allocator accepted as first arg so that all symbols have compatible
     // constructor args
     constexpr EnumTypeSymbol(std::pmr::polymorphic_allocator<> /* dummy*/,
-                             Symbol* _semantic_parent, String&& _name,
-                             std::optional<CXCursor> cursor,
-                             String&& _displayName)
-        : Symbol(_semantic_parent, kind, std::move(_name), cursor,
-                 std::move(_displayName))
+                             Symbol* _semantic_parent, UsrId _usr,
+                             std::optional<CXCursor> /* cursor */,
+                             String&& _name)
+        : Symbol(_semantic_parent, kind, _usr, std::move(_name))
     {
     }
 
@@ -210,54 +261,60 @@ struct EnumTypeSymbol : public Symbol
     [[nodiscard]] bool visit_children_impl(ClangToGraphMLBuilder::Job& job,
                                            const CXCursor& cursor) final;
 
-  public:
-    [[nodiscard]] size_t get_num_symbols_this_references() const final
-    {
-        return 0;
-    }
-
-    [[nodiscard]] Symbol* get_symbol_this_references(size_t /*index*/) final
-    {
-        return nullptr;
-    }
-
-    [[nodiscard]] Symbol*
-    get_symbol_this_references(size_t /*index*/) const final
-    {
-        return nullptr;
-    }
+    void append_references(std::pmr::vector<Reference>& /*out*/) const final {}
 };
 
 struct FunctionSymbol : public Symbol
 {
     constexpr static auto kind = SymbolKind::Function;
 
+    /// A function the body calls, and from how many places
+    struct Call
+    {
+        FunctionSymbol* callee;
+        uint32_t count;
+    };
+
     constexpr FunctionSymbol(std::pmr::polymorphic_allocator<> allocator,
-                             Symbol* semantic_parent, String&& name,
-                             std::optional<CXCursor> cursor,
-                             String&& _displayName)
-        : Symbol(semantic_parent, kind, std::move(name), cursor,
-                 std::move(_displayName)),
+                             Symbol* semantic_parent, UsrId _usr,
+                             std::optional<CXCursor> /* cursor */,
+                             String&& _name)
+        : Symbol(semantic_parent, kind, _usr, std::move(_name)),
           parameter_types(allocator)
     {
     }
 
-    [[nodiscard]] size_t get_num_symbols_this_references() const final;
-    [[nodiscard]] Symbol* get_symbol_this_references(size_t index) final;
-    [[nodiscard]] const Symbol*
-    get_symbol_this_references(size_t index) const final;
-
   protected:
     // cursor must be of type CXCursor_FunctionDecl
     [[nodiscard]] bool visit_children_impl(ClangToGraphMLBuilder::Job& job,
                                            const CXCursor& cursor) final;
 
+    void append_references(std::pmr::vector<Reference>& out) const final;
+
   public:
-    std::optional<TypeIdentifier> return_type;
+    /// Whether the cursor is a function which gets a symbol. Templates, their
+    /// instantiations, members of either, implicit members, and anything
+    /// declared inside another function like a lambda don't
+    [[nodiscard]] static bool is_representable(const CXCursor& cursor);
+
+    /// Fills in calls from the body of the function's definition. Only the job
+    /// which claimed calls_claimed may call this
+    void record_calls(ClangToGraphMLBuilder::Job& job,
+                      const CXCursor& definition);
+
+    // interned by PersistentData::types, nullptr if not parsed
+    const TypeIdentifier* return_type = nullptr;
     // if true, then parameter_types will not include the type of `this`, you
     // get that from .semantic_parent
     bool is_method = false;
-    OrderedCollection<TypeIdentifier> parameter_types;
+    OrderedCollection<const TypeIdentifier*> parameter_types;
+    // separate from visited, since any declaration gives the signature but
+    // only the definition has the body. whichever job claims this walks it
+    std::atomic<bool> calls_claimed = false;
+    // every function the body calls, once each and in the order they are
+    // first called. points into the shared arena, empty unless parsed with
+    // bodies
+    std::span<const Call> calls;
 };
 
 } // namespace cn
@@ -8,90 +8,41 @@ struct Args
     Symbol* semantic_parent;
 
     // output
-    OrderedCollection<TypeIdentifier>& type_refs;
-    OrderedCollection<TypeIdentifier>& field_types;
-    OrderedCollection<TypeIdentifier>& parent_classes;
+    OrderedCollection<const TypeIdentifier*>& type_refs;
+    OrderedCollection<const TypeIdentifier*>& field_types;
+    OrderedCollection<const TypeIdentifier*>& parent_classes;
     OrderedCollection<ClassSymbol*>& inner_classes;
     OrderedCollection<FunctionSymbol*>& member_functions;
     OrderedCollection<EnumTypeSymbol*>& inner_enums;
 };
 
-size_t ClassSymbol::get_num_symbols_this_references() const
+void ClassSymbol::append_references(std::pmr::vector<Reference>& out) const
 {
-    size_t total_symbols = 0;
-
-    const auto collect_symbol_count =
-        [&](const OrderedCollection<TypeIdentifier>& collection) {
+    const auto append_types =
+        [&](const OrderedCollection<const TypeIdentifier*>& collection,
+            EdgeKind kind) {
             for (size_t i = 0; i < collection.size(); ++i) {
-                total_symbols += collection.at(i).get_num_symbols();
+                const TypeIdentifier* iden = collection.at(i);
+                const size_t num_subsymbols = iden->get_num_symbols();
+                for (size_t j = 0; j < num_subsymbols; ++j) {
+                    out.push_back({iden->try_get_symbol(j), kind});
+                }
             }
         };
 
-    collect_symbol_count(type_refs);
-    collect_symbol_count(field_types);
-    collect_symbol_count(parent_classes);
-    total_symbols += inner_classes.size();
-    total_symbols += member_functions.size();
-    total_symbols += inner_enums.size();
-
-    return total_symbols;
-}
-
-const Symbol* ClassSymbol::get_symbol_this_references(size_t index) const
-{
-    size_t current_search_index = 0;
-    const auto find_in_type_collection =
-        [&](const OrderedCollection<TypeIdentifier>& collection)
-        -> const Symbol* {
-        for (size_t i = 0; i < collection.size(); ++i) {
-            const TypeIdentifier& iden = collection.at(i);
-            const size_t num_subsymbols = iden.get_num_symbols();
-
-            if (current_search_index <= index &&
-                current_search_index + num_subsymbols > index) {
-                return iden.try_get_symbol(index - current_search_index);
+    const auto append_members =
+        [&]<typename T>(const OrderedCollection<T*>& collection) {
+            for (size_t i = 0; i < collection.size(); ++i) {
+                out.push_back({collection.at(i), EdgeKind::Member});
             }
-
-            current_search_index += num_subsymbols;
         };
-        return nullptr;
-    };
-
-    if (const auto* sym = find_in_type_collection(type_refs)) {
-        return sym;
-    }
-    if (const auto* sym = find_in_type_collection(field_types)) {
-        return sym;
-    }
-    if (const auto* sym = find_in_type_collection(parent_classes)) {
-        return sym;
-    }
-    if (current_search_index + inner_classes.size() > index) {
-        assert(current_search_index <= index);
-        return inner_classes.at(index - current_search_index);
-    }
-    current_search_index += inner_classes.size();
-    if (current_search_index + member_functions.size() > index) {
-        assert(current_search_index <= index);
-        return member_functions.at(index - current_search_index);
-    }
-    current_search_index += member_functions.size();
-    if (current_search_index + inner_enums.size() > index) {
-        assert(current_search_index <= index);
-        return inner_enums.at(index - current_search_index);
-    }
-    current_search_index += inner_enums.size();
 
-    return nullptr;
-}
-
-Symbol* ClassSymbol::get_symbol_this_references(size_t index)
-{
-    // using const cast to avoid repeating relatively complicated getter
-    // function
-    return const_cast<Symbol*>(
-        const_cast<const ClassSymbol*>(this)->get_symbol_this_references(
-            index));
+    append_types(type_refs, EdgeKind::TypeRef);
+    append_types(field_types, EdgeKind::Field);
+    append_types(parent_classes, EdgeKind::Base);
+    append_members(inner_classes);
+    append_members(member_functions);
+    append_members(inner_enums);
 }
 
 namespace {
@@ -99,9 +50,13 @@ enum CXChildVisitResult visitor(CXCursor cursor, CXCursor /* parent */,
                                 void* userdata)
 {
     auto* args = static_cast<Args*>(userdata);
+    const bool wants_types = args->job.wants_types();
 
     switch (cursor.kind) {
     case CXCursor_CXXBaseSpecifier: {
+        if (!wants_types) {
+            return CXChildVisit_Continue;
+        }
         CXType type = get_cannonical_type(cursor);
         args->parent_classes.emplace_back(
             clang_type_to_type_identifier(args->job, type));
@@ -113,6 +68,7 @@ enum CXChildVisitResult visitor(CXCursor cursor, CXCursor /* parent */,
     }
     case CXCursor_Constructor:
     case CXCursor_Destructor:
+    case CXCursor_ConversionFunction:
     case CXCursor_CXXMethod: {
         args->member_functions.emplace_back(
             &args->job.create_or_find_symbol_with_cursor<FunctionSymbol>(
@@ -128,6 +84,9 @@ enum CXChildVisitResult visitor(CXCursor cursor, CXCursor /* parent */,
         return CXChildVisit_Continue;
     case CXCursor_VarDecl:
     case CXCursor_TypeRef: {
+        if (!wants_types) {
+            return CXChildVisit_Continue;
+        }
         CXType type = get_cannonical_type(cursor);
         args->type_refs.emplace_back(
             clang_type_to_type_identifier(args->job, type));
@@ -196,9 +155,14 @@ ClassSymbol::get_aggregate_kind_of_cursor(CXCursor cursor)
 }
 
 bool ClassSymbol::visit_children_impl(ClangToGraphMLBuilder::Job& job,
-                                      const CXCursor& cursor)
+                                      const CXCursor& input_cursor)
 {
-    // TODO: detect forward declaration here
+    // only called with a definition in reach, see has_children
+    const CXCursor cursor = clang_getCursorDefinition(input_cursor);
+    if (clang_Cursor_isNull(cursor) != 0) {
+        return false;
+    }
+
     CXType class_type = get_cannonical_type(cursor);
 
     if (class_type.kind != CXType_Record) {
@@ -220,7 +184,10 @@ bool ClassSymbol::visit_children_impl(ClangToGraphMLBuilder::Job& job,
         .inner_enums = this->inner_enums,
     };
 
-    clang_Type_visitFields(get_cannonical_type(cursor), field_visitor, &args);
+    if (job.wants_types()) {
+        clang_Type_visitFields(get_cannonical_type(cursor), field_visitor,
+                               &args);
+    }
 
     clang_visitChildren(cursor, visitor, &args);
 
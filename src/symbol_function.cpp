@@ -2,51 +2,129 @@
 #include <algorithm>
 
 namespace cn {
-size_t FunctionSymbol::get_num_symbols_this_references() const
+bool FunctionSymbol::is_representable(const CXCursor& cursor)
 {
-    size_t num = 0;
-    for (size_t i = 0; i < this->parameter_types.size(); ++i) {
-        num += this->parameter_types.at(i).get_num_symbols();
+    switch (clang_getCursorKind(cursor)) {
+    case CXCursor_FunctionDecl:
+    case CXCursor_CXXMethod:
+    case CXCursor_Constructor:
+    case CXCursor_Destructor:
+    case CXCursor_ConversionFunction:
+        break;
+    default:
+        return false;
+    }
+    // instantiations of function templates and member templates, like
+    // ident<int>, the templates themselves never get symbols either
+    if (clang_Cursor_isNull(clang_getSpecializedCursorTemplate(cursor)) == 0) {
+        return false;
+    }
+
+    const CXCursor parent = clang_getCursorSemanticParent(cursor);
+    // clang puts implicit members where the class is declared
+    if (clang_getCursorKind(parent) != CXCursor_TranslationUnit &&
+        clang_getCursorKind(parent) != CXCursor_Namespace &&
+        clang_equalLocations(clang_getCursorLocation(cursor),
+                             clang_getCursorLocation(parent)) != 0) {
+        return false;
+    }
+
+    for (CXCursor scope = parent;;
+         scope = clang_getCursorSemanticParent(scope)) {
+        switch (clang_getCursorKind(scope)) {
+        case CXCursor_TranslationUnit:
+            return true;
+        case CXCursor_Namespace:
+        case CXCursor_LinkageSpec:
+            break;
+        case CXCursor_ClassDecl:
+        case CXCursor_StructDecl:
+        case CXCursor_UnionDecl:
+            // members of class template instantiations, like Vec<int>::push
+            if (clang_Cursor_isNull(
+                    clang_getSpecializedCursorTemplate(scope)) == 0) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
     }
-    num += this->return_type.value().get_num_symbols();
-    return num;
 }
 
-Symbol* FunctionSymbol::get_symbol_this_references(size_t index)
+namespace {
+enum CXChildVisitResult call_visitor(CXCursor cursor, CXCursor /* parent */,
+                                     CXClientData client_data)
 {
-    // using const cast to avoid repeating relatively complicated getter
-    // function
-    return const_cast<Symbol*>(
-        const_cast<const FunctionSymbol*>(this)->get_symbol_this_references(
-            index));
+    // arguments and lambdas can have calls of their own, so keep going either
+    // way
+    if (clang_getCursorKind(cursor) != CXCursor_CallExpr) {
+        return CXChildVisit_Recurse;
+    }
+    auto& job = *static_cast<ClangToGraphMLBuilder::Job*>(client_data);
+
+    // callees out of scope get symbols too, whether they make it into the
+    // graph is up to ClangToGraphMLBuilder::finish
+    const CXCursor callee = clang_getCursorReferenced(cursor);
+    if (!FunctionSymbol::is_representable(callee)) {
+        return CXChildVisit_Recurse;
+    }
+
+    FunctionSymbol& symbol =
+        job.create_or_find_symbol_with_cursor<FunctionSymbol>(
+            clang_getCanonicalCursor(callee));
+    auto& calls = job.scratch->calls;
+    auto [iter, inserted] =
+        job.scratch->call_index_by_callee.try_emplace(&symbol, calls.size());
+    if (inserted) {
+        calls.push_back({.callee = &symbol, .count = 1});
+    } else {
+        ++calls[iter->second].count;
+    }
+    return CXChildVisit_Recurse;
 }
+} // namespace
 
-const Symbol* FunctionSymbol::get_symbol_this_references(size_t index) const
+void FunctionSymbol::append_references(std::pmr::vector<Reference>& out) const
 {
-    size_t iter = 0;
+    const auto append_type = [&out](const TypeIdentifier* iden,
+                                    EdgeKind kind) {
+        const size_t num_symbols = iden->get_num_symbols();
+        for (size_t i = 0; i < num_symbols; ++i) {
+            Symbol* symbol = iden->try_get_symbol(i);
+            assert(symbol);
+            out.push_back({symbol, kind});
+        }
+    };
 
     for (size_t i = 0; i < this->parameter_types.size(); ++i) {
-        const auto& iden = this->parameter_types.at(i);
-        const size_t num_symbols = iden.get_num_symbols();
-        if (iter + num_symbols <= index) {
-            iter += num_symbols;
-            continue;
-        }
-        const size_t sub_index = index - iter;
-        assert(sub_index < num_symbols);
-        auto* out = iden.try_get_symbol(sub_index);
-        if (out == nullptr) {
-            auto* out2 = iden.try_get_symbol(sub_index);
-        }
-        assert(out);
-        return out;
+        append_type(this->parameter_types.at(i), EdgeKind::Parameter);
+    }
+    // no return type if we were parsing declarations only
+    if (this->return_type != nullptr) {
+        append_type(this->return_type, EdgeKind::Return);
+    }
+    for (const Call& call : this->calls) {
+        out.push_back({call.callee, EdgeKind::Call, call.count});
+    }
+}
+
+void FunctionSymbol::record_calls(ClangToGraphMLBuilder::Job& job,
+                                  const CXCursor& definition)
+{
+    auto& calls = job.scratch->calls;
+    calls.clear();
+    job.scratch->call_index_by_callee.clear();
+    clang_visitChildren(definition, call_visitor, &job);
+
+    if (calls.empty()) {
+        return;
     }
-    const size_t num_symbols = this->return_type.value().get_num_symbols();
-    const size_t sub_index = index - iter;
-    assert(sub_index < num_symbols);
-    auto* out = this->return_type.value().try_get_symbol(sub_index);
-    assert(out);
-    return out;
+    // sized exactly, most functions only call a handful of others
+    auto* stored =
+        job.shared_data->allocator.allocate_object<Call>(calls.size());
+    std::ranges::copy(calls, stored);
+    this->calls = {stored, calls.size()};
 }
 
 bool FunctionSymbol::visit_children_impl(ClangToGraphMLBuilder::Job& job,
@@ -64,16 +142,20 @@ bool FunctionSymbol::visit_children_impl(ClangToGraphMLBuilder::Job& job,
         return false;
     }
 
+    if (!job.wants_types()) {
+        return true;
+    }
+
     CXType return_type = get_cannonical_type(clang_getResultType(type));
 
-    this->return_type.emplace(clang_type_to_type_identifier(job, return_type));
+    this->return_type = clang_type_to_type_identifier(job, return_type);
 
     if (clang_isFunctionTypeVariadic(type) == 1) {
         std::ignore =
             fprintf(stderr,
                     "WARNING: Encountered variadic function %s, pretending it "
                     "has no arguments\n",
-                    this->usr.c_str());
+                    job.shared_data->usrs.c_str(this->usr));
         return true;
     }
 
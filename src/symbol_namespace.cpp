@@ -6,7 +6,6 @@ struct Args
     ClangToGraphMLBuilder::Job& job;
     const CXCursor& cursor;
     Symbol* semantic_parent;
-    OrderedCollection<Symbol*>& symbols; // output of visitor
 };
 
 namespace {
@@ -14,8 +13,12 @@ enum CXChildVisitResult visitor(CXCursor input_cursor, CXCursor /* parent */,
                                 void* userdata)
 {
     Args* args = reinterpret_cast<Args*>(userdata);
-    CXCursor cursor = clang_getCanonicalCursor(input_cursor);
-    const enum CXCursorKind kind = clang_getCursorKind(cursor);
+    const enum CXCursorKind kind = clang_getCursorKind(input_cursor);
+    // namespace blocks are not canonicalized, every reopening of a namespace
+    // has different children
+    CXCursor cursor = kind == CXCursor_Namespace
+                          ? input_cursor
+                          : clang_getCanonicalCursor(input_cursor);
 
     if (kind >= CXCursor_FirstAttr && kind <= CXCursor_LastAttr) {
         return CXChildVisit_Recurse;
@@ -23,33 +26,41 @@ enum CXChildVisitResult visitor(CXCursor input_cursor, CXCursor /* parent */,
     if (kind == CXCursor_LinkageSpec) {
         return CXChildVisit_Recurse;
     }
+    if (args->job.is_out_of_scope(input_cursor)) {
+        return CXChildVisit_Continue;
+    }
 
     switch (kind) {
-    case CXCursorKind::CXCursor_FunctionDecl: {
-        auto& function =
-            args->job.create_or_find_symbol_with_cursor<FunctionSymbol>(cursor);
-        args->symbols.emplace_back(std::addressof(function));
+    case CXCursorKind::CXCursor_FunctionDecl:
+    // methods defined outside of their class
+    case CXCursor_CXXMethod:
+    case CXCursor_Constructor:
+    case CXCursor_Destructor:
+    case CXCursor_ConversionFunction: {
+        if (FunctionSymbol::is_representable(cursor)) {
+            args->job.mark_in_scope(
+                args->job.create_or_find_symbol_with_cursor<FunctionSymbol>(
+                    cursor));
+        }
         break;
     }
     case CXCursor_UnionDecl:
     case CXCursor_ClassDecl:
     case CXCursor_StructDecl: {
-        auto& class_symbol =
-            args->job.create_or_find_symbol_with_cursor<ClassSymbol>(cursor);
-        args->symbols.emplace_back(std::addressof(class_symbol));
+        args->job.mark_in_scope(
+            args->job.create_or_find_symbol_with_cursor<ClassSymbol>(cursor));
         break;
     }
     case CXCursor_EnumDecl: {
-        auto& enum_symbol =
-            args->job.create_or_find_symbol_with_cursor<EnumTypeSymbol>(cursor);
-        args->symbols.emplace_back(std::addressof(enum_symbol));
+        args->job.mark_in_scope(
+            args->job.create_or_find_symbol_with_cursor<EnumTypeSymbol>(
+                cursor));
         break;
     }
     case CXCursor_Namespace: {
-        auto& namespace_symbol =
+        args->job.mark_in_scope(
             args->job.create_or_find_symbol_with_cursor<NamespaceSymbol>(
-                cursor);
-        args->symbols.emplace_back(std::addressof(namespace_symbol));
+                cursor));
         break;
     }
     case CXCursor_ClassTemplate:
@@ -65,7 +76,8 @@ enum CXChildVisitResult visitor(CXCursor input_cursor, CXCursor /* parent */,
         std::ignore =
             fprintf(stderr, "unexposed decl %s found in namespace %s\n",
                     OwningCXString::clang_getCursorSpelling(cursor).c_str(),
-                    args->semantic_parent->usr.c_str());
+                    args->job.shared_data->usrs.c_str(
+                        args->semantic_parent->usr));
         break;
     default:
         std::ignore = fprintf(
@@ -80,17 +92,25 @@ enum CXChildVisitResult visitor(CXCursor input_cursor, CXCursor /* parent */,
 bool NamespaceSymbol::visit_children_impl(ClangToGraphMLBuilder::Job& job,
                                           const CXCursor& input_cursor)
 {
-    // TODO: check if this is a forward decl?
+    visit_block(job, input_cursor);
+    return false;
+}
+
+void NamespaceSymbol::visit_block(ClangToGraphMLBuilder::Job& job,
+                                  const CXCursor& input_cursor)
+{
+    // also stops recursion when a child looks up this block as its semantic
+    // parent while we are still walking it
+    if (!job.scratch->walked_namespace_blocks.insert(input_cursor).second) {
+        return;
+    }
 
     Args args{
         .job = job,
         .cursor = input_cursor,
         .semantic_parent = this,
-        .symbols = this->symbols,
     };
 
     clang_visitChildren(input_cursor, visitor, &args);
-
-    return true;
 }
 } // namespace cn
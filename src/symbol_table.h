@@ -0,0 +1,55 @@
+#ifndef __CODENODES_SYMBOL_TABLE_H__
+#define __CODENODES_SYMBOL_TABLE_H__
+
+#include <memory_resource>
+
+#include "usr_interner.h"
+
+namespace cn {
+
+struct Symbol;
+
+/// All symbols by the id of their USR. Lock free, since a USR is only ever
+/// interned once and so every symbol has a slot of its own
+class SymbolTable
+{
+  public:
+    explicit SymbolTable(std::pmr::polymorphic_allocator<> allocator)
+        : m_symbols(allocator)
+    {
+    }
+
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+    SymbolTable(SymbolTable&&) = delete;
+    SymbolTable& operator=(SymbolTable&&) = delete;
+    ~SymbolTable() = default;
+
+    /// Returns nullptr if no symbol with the given USR exists yet
+    [[nodiscard]] Symbol* find(UsrId usr) const noexcept
+    {
+        return m_symbols.get(usr);
+    }
+
+    /// Insert the symbol under the given USR. If another thread inserted a
+    /// symbol with the same USR first, that symbol is returned instead and the
+    /// one passed in should be discarded.
+    [[nodiscard]] Symbol* insert_or_get(UsrId usr, Symbol* symbol)
+    {
+        return m_symbols.insert_or_get(usr, symbol);
+    }
+
+    /// Not thread safe, only call once all jobs have finished. Visits symbols
+    /// in no particular order.
+    template <typename Callable> void for_each(Callable&& callable)
+    {
+        m_symbols.for_each(callable);
+    }
+
+  private:
+    IdTable<Symbol> m_symbols;
+};
+
+} // namespace cn
+
+#endif
@@ -5,6 +5,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <optional>
+#include <span>
 #include <variant>
 
 namespace cn {
@@ -54,24 +55,39 @@ struct UserDefinedTypeIdentifier
             .total_symbols = symbol == nullptr ? 0UL : 1UL,
         };
     }
+
+    [[nodiscard]] bool operator==(const UserDefinedTypeIdentifier&) const =
+        default;
 };
 
 struct FunctionProtoTypeIdentifier
 {
-    OrderedCollection<TypeIdentifier> types;
+    // arguments then the return type, interned by TypeTable along with the
+    // types themselves
+    std::span<const TypeIdentifier* const> types;
 
     [[nodiscard]] constexpr SymbolInfo try_get_symbol_info(size_t index) const;
+
+    /// Interned lists are only equal if they are the same list
+    [[nodiscard]] bool
+    operator==(const FunctionProtoTypeIdentifier& other) const
+    {
+        return types.data() == other.types.data() &&
+               types.size() == other.types.size();
+    }
 };
 
 struct CArrayTypeIdentifier
 {
     std::variant<FunctionProtoTypeIdentifier, UserDefinedTypeIdentifier,
-                 PrimitiveTypeType, CArrayTypeIdentifier*,
-                 PointerTypeIdentifier*>
+                 PrimitiveTypeType, const CArrayTypeIdentifier*,
+                 const PointerTypeIdentifier*>
         contents_type;
     size_t size{};
 
     [[nodiscard]] constexpr SymbolInfo try_get_symbol_info(size_t index) const;
+
+    [[nodiscard]] bool operator==(const CArrayTypeIdentifier&) const = default;
 };
 
 struct ConcreteTypeIdentifier
@@ -93,12 +109,15 @@ struct ConcreteTypeIdentifier
             },
             variant);
     }
+
+    [[nodiscard]] bool operator==(const ConcreteTypeIdentifier&) const =
+        default;
 };
 
 struct PointerTypeIdentifier
 {
     // either a pointer to another pointer, or a pointer to a concrete thing
-    std::variant<ConcreteTypeIdentifier, PointerTypeIdentifier*,
+    std::variant<ConcreteTypeIdentifier, const PointerTypeIdentifier*,
                  FunctionProtoTypeIdentifier>
         pointee_type;
 
@@ -115,6 +134,8 @@ struct PointerTypeIdentifier
             },
             pointee_type);
     }
+
+    [[nodiscard]] bool operator==(const PointerTypeIdentifier&) const = default;
 };
 
 struct NonReferenceTypeIdentifier
@@ -129,6 +150,9 @@ struct NonReferenceTypeIdentifier
             },
             variant);
     }
+
+    [[nodiscard]] bool operator==(const NonReferenceTypeIdentifier&) const =
+        default;
 };
 
 struct ReferenceTypeIdentifier
@@ -141,6 +165,9 @@ struct ReferenceTypeIdentifier
     {
         return referenced_type.try_get_symbol_info(index);
     }
+
+    [[nodiscard]] bool operator==(const ReferenceTypeIdentifier&) const =
+        default;
 };
 
 struct TypeIdentifier
@@ -163,6 +190,8 @@ struct TypeIdentifier
             .total_symbols;
     }
 
+    [[nodiscard]] bool operator==(const TypeIdentifier&) const = default;
+
     // the sum of all human knowledge
     std::variant<ReferenceTypeIdentifier, NonReferenceTypeIdentifier> variant;
 };
@@ -171,13 +200,17 @@ struct TypeIdentifier
 FunctionProtoTypeIdentifier::try_get_symbol_info(size_t index) const
 {
     size_t num_symbols = 0;
-    for (size_t i = 0; i < types.size(); ++i) {
-        num_symbols += types.at(i).get_num_symbols();
+    Symbol* queried = nullptr;
+    for (const TypeIdentifier* type : types) {
+        const size_t num_in_type = type->get_num_symbols();
+        if (queried == nullptr && index >= num_symbols &&
+            index < num_symbols + num_in_type) {
+            queried = type->try_get_symbol(index - num_symbols);
+        }
+        num_symbols += num_in_type;
     }
     return {
-        .symbol_queried = index < types.size()
-                              ? types.at(index).try_get_symbol(index)
-                              : nullptr,
+        .symbol_queried = queried,
         .total_symbols = num_symbols,
     };
 }
@@ -0,0 +1,177 @@
+#include <type_traits>
+#include <variant>
+
+#include "type_table.h"
+
+namespace cn {
+
+namespace {
+// nodes are copied into the shard arenas and never destroyed
+static_assert(std::is_trivially_copyable_v<TypeIdentifier> &&
+              std::is_trivially_destructible_v<TypeIdentifier>);
+static_assert(std::is_trivially_copyable_v<CArrayTypeIdentifier> &&
+              std::is_trivially_destructible_v<CArrayTypeIdentifier>);
+
+/// splitmix64's finalizer over both, so that pointers, which mostly differ in
+/// their low bits, still spread across all of them
+constexpr uint64_t combine(uint64_t seed, uint64_t value)
+{
+    value += 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+uint64_t hash_of(PrimitiveTypeType type);
+uint64_t hash_of(const UserDefinedTypeIdentifier& type);
+uint64_t hash_of(const FunctionProtoTypeIdentifier& type);
+uint64_t hash_of(const CArrayTypeIdentifier& type);
+uint64_t hash_of(const ConcreteTypeIdentifier& type);
+uint64_t hash_of(const PointerTypeIdentifier& type);
+uint64_t hash_of(const NonReferenceTypeIdentifier& type);
+uint64_t hash_of(const ReferenceTypeIdentifier& type);
+uint64_t hash_of(const TypeIdentifier& type);
+
+/// Whatever a pointer points to is interned, so its address is its identity
+template <typename T> uint64_t hash_of(const T* type)
+{
+    return combine(0, reinterpret_cast<uintptr_t>(type));
+}
+
+template <typename... Types>
+uint64_t hash_of(const std::variant<Types...>& variant)
+{
+    return combine(variant.index(),
+                   std::visit([](const auto& type) { return hash_of(type); },
+                              variant));
+}
+
+uint64_t hash_of(PrimitiveTypeType type)
+{
+    return combine(0, static_cast<uint64_t>(type));
+}
+
+uint64_t hash_of(const UserDefinedTypeIdentifier& type)
+{
+    return hash_of(type.symbol);
+}
+
+uint64_t hash_of(const FunctionProtoTypeIdentifier& type)
+{
+    return combine(hash_of(type.types.data()), type.types.size());
+}
+
+uint64_t hash_of(const CArrayTypeIdentifier& type)
+{
+    return combine(hash_of(type.contents_type), type.size);
+}
+
+uint64_t hash_of(const ConcreteTypeIdentifier& type)
+{
+    return hash_of(type.variant);
+}
+
+uint64_t hash_of(const PointerTypeIdentifier& type)
+{
+    return hash_of(type.pointee_type);
+}
+
+uint64_t hash_of(const NonReferenceTypeIdentifier& type)
+{
+    return hash_of(type.variant);
+}
+
+uint64_t hash_of(const ReferenceTypeIdentifier& type)
+{
+    const uint64_t flags = (static_cast<uint64_t>(type.kind) << 1) |
+                           static_cast<uint64_t>(type.is_const);
+    return combine(hash_of(type.referenced_type), flags);
+}
+
+uint64_t hash_of(const TypeIdentifier& type)
+{
+    return hash_of(type.variant);
+}
+} // namespace
+
+TypeTable::TypeTable(std::pmr::polymorphic_allocator<> allocator)
+    : m_shards(make_shards(allocator, std::make_index_sequence<num_shards>{}))
+{
+}
+
+uint64_t TypeTable::hash(const TypeIdentifier& type) noexcept
+{
+    return hash_of(type);
+}
+
+uint64_t TypeTable::hash(const PointerTypeIdentifier& type) noexcept
+{
+    return hash_of(type);
+}
+
+uint64_t TypeTable::hash(const CArrayTypeIdentifier& type) noexcept
+{
+    return hash_of(type);
+}
+
+uint64_t TypeTable::hash(TypeList types) noexcept
+{
+    uint64_t out = combine(0, types.size());
+    for (const TypeIdentifier* type : types) {
+        out = combine(out, reinterpret_cast<uintptr_t>(type));
+    }
+    return out;
+}
+
+template <typename T>
+const T* TypeTable::intern_node(const T& node, KeySet<const T*> Shard::* set)
+{
+    Shard& shard = shard_for(hash(node));
+    std::lock_guard lock(shard.mutex);
+    auto& nodes = shard.*set;
+    if (auto iter = nodes.find(&node); iter != nodes.end()) {
+        return *iter;
+    }
+
+    const T* stored =
+        std::pmr::polymorphic_allocator<>(&shard.nodes).new_object<T>(node);
+    nodes.insert(stored);
+    m_size.fetch_add(1, std::memory_order_relaxed);
+    return stored;
+}
+
+const TypeIdentifier* TypeTable::intern(const TypeIdentifier& type)
+{
+    return intern_node(type, &Shard::types);
+}
+
+const PointerTypeIdentifier*
+TypeTable::intern(const PointerTypeIdentifier& type)
+{
+    return intern_node(type, &Shard::pointers);
+}
+
+const CArrayTypeIdentifier* TypeTable::intern(const CArrayTypeIdentifier& type)
+{
+    return intern_node(type, &Shard::arrays);
+}
+
+TypeTable::TypeList TypeTable::intern(TypeList types)
+{
+    Shard& shard = shard_for(hash(types));
+    std::lock_guard lock(shard.mutex);
+    if (auto iter = shard.lists.find(types); iter != shard.lists.end()) {
+        return *iter;
+    }
+
+    std::pmr::polymorphic_allocator<> allocator(&shard.nodes);
+    auto* stored = allocator.allocate_object<const TypeIdentifier*>(
+        std::max<size_t>(types.size(), 1));
+    std::ranges::copy(types, stored);
+    const TypeList out{stored, types.size()};
+    shard.lists.insert(out);
+    m_size.fetch_add(1, std::memory_order_relaxed);
+    return out;
+}
+
+} // namespace cn
@@ -0,0 +1,134 @@
+#ifndef __CODENODES_TYPE_TABLE_H__
+#define __CODENODES_TYPE_TABLE_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <span>
+#include <unordered_set>
+#include <utility>
+
+#include "type_identifier.h"
+
+namespace cn {
+
+/// Every distinct type any job has converted, each stored once. Stored types
+/// are immutable and only ever point at other stored types, so two types are
+/// the same type exactly when they are the same pointer. Thread safe
+class TypeTable
+{
+  public:
+    using TypeList = std::span<const TypeIdentifier* const>;
+
+    /// allocator must be thread safe
+    explicit TypeTable(std::pmr::polymorphic_allocator<> allocator);
+
+    TypeTable(const TypeTable&) = delete;
+    TypeTable& operator=(const TypeTable&) = delete;
+    TypeTable(TypeTable&&) = delete;
+    TypeTable& operator=(TypeTable&&) = delete;
+    ~TypeTable() = default;
+
+    /// The stored copy of the type, storing it first if this is the first time
+    /// it was seen. Anything it points to must have been interned already
+    [[nodiscard]] const TypeIdentifier* intern(const TypeIdentifier& type);
+    [[nodiscard]] const PointerTypeIdentifier*
+    intern(const PointerTypeIdentifier& type);
+    [[nodiscard]] const CArrayTypeIdentifier*
+    intern(const CArrayTypeIdentifier& type);
+
+    /// For the argument lists of function pointers. types only has to live
+    /// until this returns
+    [[nodiscard]] TypeList intern(TypeList types);
+
+    /// Number of distinct types, pointees, arrays and argument lists
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] static uint64_t hash(const TypeIdentifier& type) noexcept;
+    [[nodiscard]] static uint64_t
+    hash(const PointerTypeIdentifier& type) noexcept;
+    [[nodiscard]] static uint64_t
+    hash(const CArrayTypeIdentifier& type) noexcept;
+    [[nodiscard]] static uint64_t hash(TypeList types) noexcept;
+
+  private:
+    struct KeyHash
+    {
+        template <typename T> size_t operator()(const T* node) const noexcept
+        {
+            return hash(*node);
+        }
+
+        size_t operator()(TypeList types) const noexcept
+        {
+            return hash(types);
+        }
+    };
+
+    struct KeyEqual
+    {
+        template <typename T>
+        bool operator()(const T* lhs, const T* rhs) const noexcept
+        {
+            return *lhs == *rhs;
+        }
+
+        bool operator()(TypeList lhs, TypeList rhs) const noexcept
+        {
+            return std::ranges::equal(lhs, rhs);
+        }
+    };
+
+    template <typename Key>
+    using KeySet = std::pmr::unordered_set<Key, KeyHash, KeyEqual>;
+
+    struct Shard
+    {
+        explicit Shard(std::pmr::polymorphic_allocator<> allocator)
+            : nodes(allocator.resource()), types(allocator),
+              pointers(allocator), arrays(allocator), lists(allocator)
+        {
+        }
+
+        std::mutex mutex;
+        // every type stored in this shard
+        std::pmr::monotonic_buffer_resource nodes;
+        KeySet<const TypeIdentifier*> types;
+        KeySet<const PointerTypeIdentifier*> pointers;
+        KeySet<const CArrayTypeIdentifier*> arrays;
+        KeySet<TypeList> lists;
+    };
+
+    static constexpr size_t num_shards = 64;
+
+    template <size_t... indices>
+    static std::array<Shard, num_shards>
+    make_shards(std::pmr::polymorphic_allocator<> allocator,
+                std::index_sequence<indices...> /**/)
+    {
+        return {((void)indices, Shard{allocator})...};
+    }
+
+    [[nodiscard]] Shard& shard_for(uint64_t hash)
+    {
+        // the low bits pick the bucket within the shard
+        return m_shards[(hash >> 32) % num_shards];
+    }
+
+    template <typename T>
+    [[nodiscard]] const T* intern_node(const T& node,
+                                       KeySet<const T*> Shard::* set);
+
+    std::array<Shard, num_shards> m_shards;
+    std::atomic<size_t> m_size = 0;
+};
+
+} // namespace cn
+
+#endif
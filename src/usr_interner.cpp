@@ -0,0 +1,57 @@
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <tuple>
+
+#include "usr_interner.h"
+
+namespace cn {
+
+UsrInterner::UsrInterner(std::pmr::polymorphic_allocator<> allocator)
+    : m_shards(make_shards(allocator, std::make_index_sequence<num_shards>{})),
+      m_by_id(allocator)
+{
+    [[maybe_unused]] const UsrId id = intern("");
+    assert(id == empty);
+}
+
+std::optional<UsrId> UsrInterner::find(std::string_view usr, uint64_t hash)
+{
+    Shard& shard = shard_for(hash);
+    std::lock_guard lock(shard.mutex);
+    if (const Entry* entry = shard.entries.find(usr, hash)) {
+        return entry->id;
+    }
+    return {};
+}
+
+UsrId UsrInterner::intern(std::string_view usr, uint64_t hash)
+{
+    Shard& shard = shard_for(hash);
+    std::lock_guard lock(shard.mutex);
+    if (const Entry* entry = shard.entries.find(usr, hash)) {
+        return entry->id;
+    }
+
+    const UsrId id = m_next_id.fetch_add(1, std::memory_order_relaxed);
+    assert(id != std::numeric_limits<UsrId>::max());
+
+    void* memory =
+        shard.bytes.allocate(sizeof(Entry) + usr.size() + 1, alignof(Entry));
+    auto* entry = new (memory) Entry{
+        .id = id,
+        .size = static_cast<uint32_t>(usr.size()),
+    };
+    char* bytes = reinterpret_cast<char*>(entry + 1);
+    std::memcpy(bytes, usr.data(), usr.size());
+    bytes[usr.size()] = '\0';
+
+    std::ignore = shard.entries.insert_or_get({bytes, usr.size()}, hash, entry);
+    // published before the lock is released, so whoever gets the id from
+    // find() can also view() it
+    std::ignore = m_by_id.insert_or_get(id, entry);
+    return id;
+}
+
+} // namespace cn
@@ -0,0 +1,219 @@
+#ifndef __CODENODES_USR_INTERNER_H__
+#define __CODENODES_USR_INTERNER_H__
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "usr_map.h"
+
+namespace cn {
+
+/// Refers to a USR stored in a UsrInterner
+using UsrId = uint32_t;
+
+/// Array of pointers indexed by UsrId which grows a page at a time, so that
+/// nothing in it ever moves and it can be read and written from several
+/// threads at once without locks
+template <typename T> class IdTable
+{
+  public:
+    explicit IdTable(std::pmr::polymorphic_allocator<> allocator)
+        : m_allocator(allocator)
+    {
+    }
+
+    IdTable(const IdTable&) = delete;
+    IdTable& operator=(const IdTable&) = delete;
+    IdTable(IdTable&&) = delete;
+    IdTable& operator=(IdTable&&) = delete;
+
+    ~IdTable()
+    {
+        for (auto& page : m_pages) {
+            if (auto* slots = page.load(std::memory_order_relaxed)) {
+                m_allocator.deallocate_object(slots, page_size);
+            }
+        }
+    }
+
+    /// nullptr if nothing was stored under the id
+    [[nodiscard]] T* get(UsrId id) const noexcept
+    {
+        const auto* slots =
+            m_pages[id / page_size].load(std::memory_order_acquire);
+        if (slots == nullptr) {
+            return nullptr;
+        }
+        return slots[id % page_size].load(std::memory_order_acquire);
+    }
+
+    /// Store value under the id unless something already is, and return
+    /// whichever is stored afterwards
+    [[nodiscard]] T* insert_or_get(UsrId id, T* value)
+    {
+        std::atomic<T*>& slot = page_for(id)[id % page_size];
+        T* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, value,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+            return value;
+        }
+        return expected;
+    }
+
+    /// Not thread safe. Visits values in id order
+    template <typename Callable> void for_each(Callable&& callable) const
+    {
+        for (const auto& page : m_pages) {
+            const auto* slots = page.load(std::memory_order_acquire);
+            if (slots == nullptr) {
+                continue;
+            }
+            for (size_t i = 0; i < page_size; ++i) {
+                if (T* value = slots[i].load(std::memory_order_relaxed)) {
+                    callable(value);
+                }
+            }
+        }
+    }
+
+  private:
+    static constexpr size_t page_size = size_t{1} << 16;
+    static constexpr size_t num_pages = (size_t{1} << 32) / page_size;
+
+    std::atomic<T*>* page_for(UsrId id)
+    {
+        auto& page = m_pages[id / page_size];
+        std::atomic<T*>* existing = page.load(std::memory_order_acquire);
+        if (existing != nullptr) {
+            return existing;
+        }
+
+        auto* fresh = m_allocator.allocate_object<std::atomic<T*>>(page_size);
+        for (size_t i = 0; i < page_size; ++i) {
+            std::construct_at(fresh + i, nullptr);
+        }
+        if (page.compare_exchange_strong(existing, fresh,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+            return fresh;
+        }
+        // another thread got there first
+        m_allocator.deallocate_object(fresh, page_size);
+        return existing;
+    }
+
+    std::pmr::polymorphic_allocator<> m_allocator;
+    std::array<std::atomic<std::atomic<T*>*>, num_pages> m_pages{};
+};
+
+/// Every USR any job has seen, each stored once and referred to everywhere
+/// else by its UsrId. Thread safe
+class UsrInterner
+{
+  public:
+    /// The empty USR, given to the global namespace
+    static constexpr UsrId empty = 0;
+
+    /// allocator must be thread safe
+    explicit UsrInterner(std::pmr::polymorphic_allocator<> allocator);
+
+    UsrInterner(const UsrInterner&) = delete;
+    UsrInterner& operator=(const UsrInterner&) = delete;
+    UsrInterner(UsrInterner&&) = delete;
+    UsrInterner& operator=(UsrInterner&&) = delete;
+    ~UsrInterner() = default;
+
+    [[nodiscard]] static uint64_t hash(std::string_view usr) noexcept
+    {
+        return UsrMap<const Entry>::hash(usr);
+    }
+
+    /// Nullopt if the USR was never interned
+    [[nodiscard]] std::optional<UsrId> find(std::string_view usr,
+                                            uint64_t hash);
+
+    /// The id of the USR, storing it first if this is the first time it was
+    /// seen. USRs which were already seen cost a single probe
+    [[nodiscard]] UsrId intern(std::string_view usr, uint64_t hash);
+
+    [[nodiscard]] UsrId intern(std::string_view usr)
+    {
+        return intern(usr, hash(usr));
+    }
+
+    /// Null terminated, and valid for as long as the interner is
+    [[nodiscard]] std::string_view view(UsrId id) const noexcept
+    {
+        const Entry* entry = m_by_id.get(id);
+        return {entry->bytes(), entry->size};
+    }
+
+    [[nodiscard]] const char* c_str(UsrId id) const noexcept
+    {
+        return m_by_id.get(id)->bytes();
+    }
+
+    /// Number of distinct USRs
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return m_next_id.load(std::memory_order_relaxed);
+    }
+
+  private:
+    /// Header in front of the bytes of each USR
+    struct Entry
+    {
+        UsrId id;
+        uint32_t size;
+
+        [[nodiscard]] const char* bytes() const
+        {
+            return reinterpret_cast<const char*>(this + 1);
+        }
+    };
+
+    struct Shard
+    {
+        explicit Shard(std::pmr::polymorphic_allocator<> allocator)
+            : bytes(allocator.resource()), entries(allocator)
+        {
+        }
+
+        std::mutex mutex;
+        // every entry in this shard, back to back
+        std::pmr::monotonic_buffer_resource bytes;
+        UsrMap<const Entry> entries;
+    };
+
+    static constexpr size_t num_shards = 64;
+
+    template <size_t... indices>
+    static std::array<Shard, num_shards>
+    make_shards(std::pmr::polymorphic_allocator<> allocator,
+                std::index_sequence<indices...> /**/)
+    {
+        return {((void)indices, Shard{allocator})...};
+    }
+
+    [[nodiscard]] Shard& shard_for(uint64_t hash)
+    {
+        // the low bits pick the slot within the shard
+        return m_shards[(hash >> 32) % num_shards];
+    }
+
+    std::array<Shard, num_shards> m_shards;
+    std::atomic<UsrId> m_next_id = 0;
+    IdTable<const Entry> m_by_id;
+};
+
+} // namespace cn
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef __CODENODES_USR_MAP_H__
+#define __CODENODES_USR_MAP_H__
+
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+namespace cn {
+
+/// Open addressing hash table from USRs to pointers, for when the USR is owned
+/// by whatever the pointer points to. Linear probing, and every slot keeps the
+/// full hash, so a probe only compares strings when the hashes match. Not
+/// thread safe, and nothing is ever removed
+template <typename T> class UsrMap
+{
+  public:
+    /// Hash a USR once, then use it for any number of lookups
+    [[nodiscard]] static uint64_t hash(std::string_view usr) noexcept
+    {
+        return std::hash<std::string_view>{}(usr);
+    }
+
+    explicit UsrMap(std::pmr::polymorphic_allocator<> allocator)
+        : m_slots(allocator)
+    {
+    }
+
+    UsrMap(const UsrMap&) = delete;
+    UsrMap& operator=(const UsrMap&) = delete;
+    UsrMap(UsrMap&&) noexcept = default;
+    UsrMap& operator=(UsrMap&&) = delete;
+    ~UsrMap() = default;
+
+    /// Returns nullptr if there is nothing under the USR
+    [[nodiscard]] T* find(std::string_view usr, uint64_t hash) const noexcept
+    {
+        if (m_slots.empty()) {
+            return nullptr;
+        }
+        return m_slots[probe(usr, hash)].value;
+    }
+
+    /// Returns what is already under the USR, or inserts value and returns it.
+    /// The USR is not copied, it has to live as long as the map does
+    [[nodiscard]] T* insert_or_get(std::string_view usr, uint64_t hash,
+                                   T* value)
+    {
+        // keep at most three quarters full, linear probing falls apart past
+        // that
+        if ((m_size + 1) * 4 > m_slots.size() * 3) {
+            grow();
+        }
+
+        Slot& slot = m_slots[probe(usr, hash)];
+        if (slot.value == nullptr) {
+            slot = {.hash = hash, .usr = usr, .value = value};
+            ++m_size;
+        }
+        return slot.value;
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return m_size; }
+
+    /// Visits values in no particular order
+    template <typename Callable> void for_each(Callable&& callable) const
+    {
+        for (const Slot& slot : m_slots) {
+            if (slot.value != nullptr) {
+                callable(slot.value);
+            }
+        }
+    }
+
+  private:
+    struct Slot
+    {
+        uint64_t hash = 0;
+        std::string_view usr;
+        // nullptr if the slot is empty
+        T* value = nullptr;
+    };
+
+    static constexpr size_t initial_capacity = 64;
+    static_assert(std::has_single_bit(initial_capacity));
+
+    /// Index of the slot holding the USR, or of the empty slot it would go in.
+    /// There is always at least one empty slot
+    [[nodiscard]] size_t probe(std::string_view usr,
+                               uint64_t hash) const noexcept
+    {
+        const size_t mask = m_slots.size() - 1;
+        for (size_t index = hash & mask;; index = (index + 1) & mask) {
+            const Slot& slot = m_slots[index];
+            if (slot.value == nullptr ||
+                (slot.hash == hash && slot.usr == usr)) {
+                return index;
+            }
+        }
+    }
+
+    void grow()
+    {
+        const size_t capacity =
+            m_slots.empty() ? initial_capacity : m_slots.size() * 2;
+        std::pmr::vector<Slot> old(capacity, m_slots.get_allocator());
+        old.swap(m_slots);
+
+        for (const Slot& slot : old) {
+            if (slot.value == nullptr) {
+                continue;
+            }
+            // no duplicates, so the first empty slot is the one
+            const size_t mask = m_slots.size() - 1;
+            size_t index = slot.hash & mask;
+            while (m_slots[index].value != nullptr) {
+                index = (index + 1) & mask;
+            }
+            m_slots[index] = slot;
+        }
+    }
+
+    // always a power of two in size, or empty
+    std::pmr::vector<Slot> m_slots;
+    size_t m_size = 0;
+};
+
+} // namespace cn
+
+#endif
@@ -0,0 +1,30 @@
+// Input for check_calls.sh. Only plain functions and methods should end up
+// with call edges, the templates and their instantiations get no nodes
+
+template <typename T> struct Vec
+{
+    void push(T value) { last = value; }
+    T last;
+};
+
+template <typename T> T ident(T value) { return value; }
+
+struct Holder
+{
+    template <typename T> T get(T value) const { return value; }
+    void run();
+};
+
+void plain(int) {}
+
+void caller()
+{
+    Vec<int> v;
+    v.push(1);
+    ident(3);
+    Holder{}.get(2);
+    plain(1);
+    plain(2);
+}
+
+void Holder::run() { caller(); }
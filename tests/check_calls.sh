@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+# Calls in function bodies become one call edge per callee, weighted by the
+# number of call sites, and calls into templates leave no trace.
+#
+# usage: tests/check_calls.sh path/to/codenodes
+
+set -euo pipefail
+source "$(dirname "$0")/common.sh"
+
+codenodes=$1
+output_dir=$(mktemp -d)
+trap 'rm -rf "$output_dir"' EXIT
+
+write_compile_commands "$output_dir" calls.cpp
+"$codenodes" -c "$output_dir/compile_commands.json" --depth bodies \
+    -o "$output_dir/calls.graphml"
+graph=$output_dir/calls.graphml
+
+expect_edge "$graph" "caller()" "plain(int)" \
+    '<data key="edge_kind">call</data><data key="weight">2</data>'
+expect_edge "$graph" "Holder::run()" "caller()" \
+    '<data key="edge_kind">call</data>'
+
+# Vec<int>::push, ident<int> and Holder::get<int> were all called
+for name in Vec ident get; do
+    if grep -q "<data key=\"name\">[^<]*$name" "$graph"; then
+        fail "template instantiation $name has a node"
+    fi
+done
+if [ "$(grep -c 'edge_kind">call' "$graph")" -ne 2 ]; then
+    fail "expected exactly 2 call edges"
+fi
+
+echo "calls ok"
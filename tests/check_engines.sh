@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+# The visitor and indexer engines find the same symbols and edges, and so
+# write the same graph, at every depth.
+#
+# usage: tests/check_engines.sh path/to/codenodes
+
+set -euo pipefail
+source "$(dirname "$0")/common.sh"
+
+codenodes=$1
+output_dir=$(mktemp -d)
+trap 'rm -rf "$output_dir"' EXIT
+
+write_compile_commands "$output_dir" engines.cpp calls.cpp
+for depth in decls signatures bodies; do
+    for engine in visitor indexer; do
+        "$codenodes" -c "$output_dir/compile_commands.json" -j 1 \
+            --engine "$engine" --depth "$depth" \
+            -o "$output_dir/$engine-$depth.graphml"
+    done
+    cmp -s "$output_dir/visitor-$depth.graphml" \
+        "$output_dir/indexer-$depth.graphml" ||
+        fail "engines disagree at depth $depth"
+done
+
+echo "engines ok"
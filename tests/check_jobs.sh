@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+# The graph does not depend on how many jobs ran, or on which of them got to
+# a symbol first.
+#
+# usage: tests/check_jobs.sh path/to/codenodes
+
+set -euo pipefail
+source "$(dirname "$0")/common.sh"
+
+codenodes=$1
+output_dir=$(mktemp -d)
+trap 'rm -rf "$output_dir"' EXIT
+
+# the declaring file a few times over, so that with several jobs one of them
+# likely gets to Widget before the job with its definition does
+write_compile_commands "$output_dir" jobs_declared.cpp jobs_declared.cpp \
+    jobs_declared.cpp jobs_defined.cpp
+for jobs in 1 4; do
+    "$codenodes" -c "$output_dir/compile_commands.json" -j "$jobs" \
+        --depth bodies -o "$output_dir/jobs-$jobs.graphml"
+done
+graph=$output_dir/jobs-4.graphml
+
+expect_edge "$graph" "Widget" "Part" \
+    '<data key="edge_kind">field</data><data key="weight">2</data>'
+expect_edge "$graph" "draw_twice(Widget *)" "draw(Widget *)" \
+    '<data key="edge_kind">call</data><data key="weight">2</data>'
+cmp -s "$output_dir/jobs-1.graphml" "$graph" ||
+    fail "output with 4 jobs differs from output with 1"
+
+echo "jobs ok"
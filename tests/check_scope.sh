@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+# A header is in scope if any translation unit has it in scope, so the graph
+# does not depend on which translation unit gets to a symbol first, even when
+# they disagree about a header's include depth.
+#
+# usage: tests/check_scope.sh path/to/codenodes
+
+set -euo pipefail
+source "$(dirname "$0")/common.sh"
+
+codenodes=$1
+output_dir=$(mktemp -d)
+trap 'rm -rf "$output_dir"' EXIT
+
+# with one job, whichever file comes first fills in Holder and read_holder
+run() {
+    write_compile_commands "$output_dir" "$@"
+    "$codenodes" -c "$output_dir/compile_commands.json" -j 1 \
+        --depth bodies --max-include-depth 1 -o "$output_dir/$1.graphml"
+}
+run scope_nested.cpp scope_direct.cpp
+run scope_direct.cpp scope_nested.cpp
+graph=$output_dir/scope_nested.cpp.graphml
+
+expect_edge "$graph" "Holder" "Deep" '<data key="edge_kind">field</data>'
+expect_edge "$graph" "read_holder(Holder)" "read_deep(Deep)" \
+    '<data key="edge_kind">call</data>'
+cmp -s "$graph" "$output_dir/scope_direct.cpp.graphml" ||
+    fail "output depends on the order of the translation units"
+
+echo "scope ok"
@@ -0,0 +1,44 @@
+# Shared by the check scripts. Each runs codenodes on files from this
+# directory and looks at the GraphML it wrote.
+
+tests_dir=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+
+# write_compile_commands <output dir> <source>...
+# one entry per source, all with the same flags
+write_compile_commands() {
+    local dir=$1
+    shift
+    {
+        echo "["
+        local separator=""
+        for source in "$@"; do
+            printf '%s{"directory": "%s", "file": "%s", "arguments": ["clang++", "-std=c++20", "-c", "%s"]}\n' \
+                "$separator" "$tests_dir" "$tests_dir/$source" \
+                "$tests_dir/$source"
+            separator=","
+        done
+        echo "]"
+    } >"$dir/compile_commands.json"
+}
+
+# node_id <graphml> <qualified name>
+node_id() {
+    grep -F "<data key=\"name\">$2</data>" "$1" |
+        sed 's/.*<node id="\([^"]*\)".*/\1/'
+}
+
+# expect_edge <graphml> <source name> <target name> <edge data>
+expect_edge() {
+    local source target
+    source=$(node_id "$1" "$2")
+    target=$(node_id "$1" "$3")
+    [ -n "$source" ] || fail "no node $2"
+    [ -n "$target" ] || fail "no node $3"
+    grep -qF "<edge source=\"$source\" target=\"$target\">$4</edge>" \
+        "$1" || fail "no edge $2 -> $3 with $4"
+}
+
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
@@ -0,0 +1,127 @@
+// Checks that compile commands are turned into the arguments clang gets.
+// Exits with 1 and prints what differed if any check fails
+
+#include <algorithm>
+#include <cstdio>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "compile_args.h"
+
+namespace {
+bool failed = false;
+
+void check_args(const char* what, std::span<const std::string_view> actual,
+                std::initializer_list<std::string_view> expected)
+{
+    if (std::ranges::equal(actual, expected)) {
+        return;
+    }
+    failed = true;
+    std::ignore = fprintf(stderr, "%s:\n  expected:", what);
+    for (std::string_view arg : expected) {
+        std::ignore = fprintf(stderr, " [%.*s]", static_cast<int>(arg.size()),
+                              arg.data());
+    }
+    std::ignore = fprintf(stderr, "\n  actual:  ");
+    for (std::string_view arg : actual) {
+        std::ignore = fprintf(stderr, " [%.*s]", static_cast<int>(arg.size()),
+                              arg.data());
+    }
+    std::ignore = fprintf(stderr, "\n");
+}
+
+void check_tokens(std::string_view command,
+                  std::initializer_list<std::string_view> expected)
+{
+    std::string tokens;
+    cn::tokenize_command(command, tokens);
+
+    std::vector<std::string_view> actual;
+    for (size_t begin = 0; begin < tokens.size();) {
+        const size_t end = tokens.find('\0', begin);
+        actual.emplace_back(tokens.data() + begin, end - begin);
+        begin = end + 1;
+    }
+
+    const std::string what = "tokenize_command(" + std::string{command} + ")";
+    check_args(what.c_str(), actual, expected);
+}
+
+void check_command(const cn::CompileCommand& command, std::string_view file,
+                   std::initializer_list<std::string_view> expected)
+{
+    if (command.file != file) {
+        failed = true;
+        std::ignore = fprintf(stderr, "file: expected %.*s, got %s\n",
+                              static_cast<int>(file.size()), file.data(),
+                              command.file.c_str());
+    }
+
+    const std::vector<std::string_view> actual{command.args.begin(),
+                                               command.args.end()};
+    const std::string what = "args of " + command.file;
+    check_args(what.c_str(), actual, expected);
+}
+} // namespace
+
+int main()
+{
+    check_tokens("clang++  -c\tfoo.cpp", {"clang++", "-c", "foo.cpp"});
+    check_tokens(R"(cc "-DNAME=a b" 'it''s' "")",
+                 {"cc", "-DNAME=a b", "its", ""});
+    check_tokens(R"(cc 'a\b "c"')", {"cc", R"(a\b "c")"});
+    check_tokens(R"(cc "a\"b\\c\d")", {"cc", R"(a"b\c\d)"});
+    check_tokens(R"(cc a\ b \"c\")", {"cc", "a b", R"("c")"});
+
+    cn::CompileArgsTable table;
+
+    // output, dependency file and warning flags go, along with their values,
+    // but -Wp, passes flags to the preprocessor
+    const cn::CompileCommandEntry dropped{
+        .directory = "/work/build",
+        .command = "clang++ -c ../src/a.cpp -o a.o -MJ a.json -MF a.d -Wall "
+                   "-Wp,-DFROM_WP -std=c++20",
+        .file = "../src/a.cpp",
+    };
+    check_command(table.add(dropped), "/work/src/a.cpp",
+                  {"clang++", "-Wp,-DFROM_WP", "-std=c++20"});
+
+    // relative paths are resolved against the entry's directory, whether the
+    // path is separate, attached or in a response file. -D keeps its value
+    // even if it looks like a flag that is dropped
+    const std::string_view arguments[] = {
+        "clang++",    "-I", "include", "-I../shared", "-isystem", "/usr/x",
+        "@flags.rsp", "-D", "-o",      "b.cpp",
+    };
+    const cn::CompileCommandEntry paths{
+        .directory = "/work",
+        .arguments = arguments,
+        .file = "b.cpp",
+    };
+    check_command(table.add(paths), "/work/b.cpp",
+                  {"clang++", "-I", "/work/include", "-I/shared", "-isystem",
+                   "/usr/x", "@/work/flags.rsp", "-D", "-o"});
+
+    // the same flags for another file share their args
+    const cn::CompileCommand first = table.add({
+        .directory = "/work",
+        .command = "cc -O2 -c one.c",
+        .file = "one.c",
+    });
+    const cn::CompileCommand second = table.add({
+        .directory = "/work",
+        .command = "cc -O2 -c two.c",
+        .file = "two.c",
+    });
+    if (first.args.data() != second.args.data() || table.size() != 3) {
+        failed = true;
+        std::ignore = fprintf(stderr, "identical args were not shared\n");
+    }
+
+    return failed ? 1 : 0;
+}
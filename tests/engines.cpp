@@ -0,0 +1,93 @@
+// Input for check_engines.sh, a bit of everything either engine has to find
+// the same way
+
+extern "C" {
+int c_function(int value);
+}
+
+namespace outer {
+enum class Color
+{
+    Red,
+    Green,
+};
+
+struct Base
+{
+    virtual ~Base();
+    int id;
+};
+
+class Widget : public Base
+{
+  public:
+    Widget();
+    ~Widget() override;
+    explicit operator bool() const;
+    void draw(Color color) const;
+
+    struct Part
+    {
+        Widget* owner;
+        void attach();
+    };
+
+    enum Size
+    {
+        Small,
+        Large,
+    };
+
+  private:
+    Part parts[4];
+    Size size;
+};
+
+namespace inner {
+void helper(const Widget& widget);
+} // namespace inner
+
+namespace {
+int hidden(int value)
+{
+    return value * 2;
+}
+} // namespace
+} // namespace outer
+
+outer::Base::~Base() = default;
+outer::Widget::Widget() : Base{}, parts{}, size{Small} {}
+outer::Widget::~Widget() = default;
+
+outer::Widget::operator bool() const { return size == Large; }
+
+void outer::Widget::draw(Color color) const
+{
+    struct Local
+    {
+        int value;
+        void poke() {}
+    };
+    Local local{hidden(1)};
+    local.poke();
+    inner::helper(*this);
+    c_function(static_cast<int>(color));
+}
+
+void outer::Widget::Part::attach() { owner->draw(outer::Color::Red); }
+
+namespace outer::inner {
+void helper(const Widget& widget)
+{
+    if (widget) {
+        widget.draw(Color::Green);
+    }
+}
+} // namespace outer::inner
+
+int main()
+{
+    outer::Widget widget;
+    widget.draw(outer::Color::Red);
+    return c_function(0);
+}
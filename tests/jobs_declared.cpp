@@ -0,0 +1,13 @@
+// Input for check_jobs.sh, together with jobs_defined.cpp. Widget is only
+// declared here, so whichever job gets to it first, the one parsing
+// jobs_defined.cpp has to be the one to fill it in
+
+struct Widget;
+
+void draw(Widget* widget);
+
+void draw_twice(Widget* widget)
+{
+    draw(widget);
+    draw(widget);
+}
@@ -0,0 +1,14 @@
+// Input for check_jobs.sh, see jobs_declared.cpp
+
+struct Part
+{
+    int size;
+};
+
+struct Widget
+{
+    Part part;
+    Part* spare;
+};
+
+void draw(Widget* widget) { widget->spare = &widget->part; }
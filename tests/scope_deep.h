@@ -0,0 +1,11 @@
+// Input for check_scope.sh, one #include away from scope_direct.cpp and two
+// away from scope_nested.cpp
+
+#pragma once
+
+struct Deep
+{
+    int value;
+};
+
+inline int read_deep(Deep deep) { return deep.value; }
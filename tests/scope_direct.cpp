@@ -0,0 +1,6 @@
+// Input for check_scope.sh, has scope_deep.h within --max-include-depth 1
+
+#include "scope_deep.h"
+#include "scope_shallow.h"
+
+int direct(Holder holder) { return read_holder(holder); }
@@ -0,0 +1,6 @@
+// Input for check_scope.sh, only reaches scope_deep.h through
+// scope_shallow.h, past --max-include-depth 1
+
+#include "scope_shallow.h"
+
+int nested(Holder holder) { return read_holder(holder); }
@@ -0,0 +1,12 @@
+// Input for check_scope.sh, included directly by both source files
+
+#pragma once
+
+#include "scope_deep.h"
+
+struct Holder
+{
+    Deep deep;
+};
+
+inline int read_holder(Holder holder) { return read_deep(holder.deep); }
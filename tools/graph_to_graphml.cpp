@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <argz/argz.hpp>
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "graph_file.h"
+#include "graphml_writer.h"
+
+int main(int argc, const char* argv[])
+{
+    constexpr std::string_view version = "0.0.1";
+    argz::about about{
+        .description = "Converts a graph written by codenodes --binary-output "
+                       "to GraphML, the same as codenodes --output would have "
+                       "written.",
+        .version = version,
+        .print_help_when_no_options = true,
+    };
+
+    std::optional<std::string> input_path{};
+    std::optional<std::string> output_path{};
+    uint32_t num_jobs = 1;
+    argz::options opts{
+        {
+            .ids = {.id = "input", .alias = 'i'},
+            .value = input_path,
+            .help = "path to the binary graph file",
+        },
+        {
+            .ids = {.id = "output", .alias = 'o'},
+            .value = output_path,
+            .help = "path to the output GraphML file",
+        },
+        {
+            .ids = {.id = "jobs", .alias = 'j'},
+            .value = num_jobs,
+            .help = "number of threads to format GraphML on, or 0 to use one "
+                    "per hardware thread",
+        },
+    };
+
+    try {
+        argz::parse(about, opts, argc, argv);
+    } catch (const std::exception& e) {
+        std::ignore =
+            fprintf(stderr, "Bad command line arguments: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (!input_path.has_value() || !output_path.has_value()) {
+        std::ignore = fprintf(stderr, "Provide an input and an output file\n");
+        return EXIT_FAILURE;
+    }
+
+    const auto graph = cn::GraphFile::open(input_path.value());
+    if (!graph.has_value()) {
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream output_file(output_path.value());
+    if (!output_file) {
+        std::ignore =
+            fprintf(stderr, "Unable to open output file %s for writing.\n",
+                    output_path.value().c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (num_jobs == 0) {
+        num_jobs = std::max(1U, std::thread::hardware_concurrency());
+    }
+    return cn::write_graphml(graph->view(), output_file, num_jobs)
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+}